@@ -0,0 +1,1159 @@
+/* RLHK benchmark suite
+ *
+ * Times the hot functions of each header against seeded synthetic
+ * maps and prints one tab-separated record per benchmark:
+ *
+ *     bench  map  size  iterations  ns/op  nodes/sec
+ *
+ * Everything is seeded, so runs are comparable between releases. The
+ * "nodes" are passability queries for the map searches, path queries
+ * answered by each worker's share of a batch, tiles reached by the
+ * fields of dijkstra_many and of each worker's share, light sources
+ * recomputed for lighting, tiles marked visible for FOV, processed
+ * cells for the generators and diffusion, points placed for
+ * Poisson-disk sampling, seeds for entropy, actors for the scheduler,
+ * entities moved or found for the spatial index, chunks loaded for
+ * the chunk cache, and tiles read from level images, and are 0 where
+ * not meaningful.
+ *
+ * Queries and tiles are counted in an untimed pass after each timed
+ * loop, so the timings are of a release build of each header, without
+ * RLHK_ALGO_STATS.
+ *
+ * Build and run with "make bench".
+ */
+typedef struct bench_map *rlhk_algo_map;
+typedef struct bench_world *rlhk_chunk_world;
+
+#define RLHK_API static
+#define RLHK_IMPLEMENTATION
+#define RLHK_TUI_MAX_WIDTH  200
+#define RLHK_TUI_MAX_HEIGHT 60
+#define RLHK_TUI_WRITE(fd, buf, len) bench_sink(buf, len)
+#define RLHK_TUI_TCSETATTR(fd, act, t) 0
+static long bench_sink(const void *, long);
+#include "../rlhk_tui.h"
+#include "../rlhk_rand.h"
+#include "../rlhk_algo.h"
+#include "../rlhk_gen.h"
+#include "../rlhk_light.h"
+#include "../rlhk_sched.h"
+#include "../rlhk_space.h"
+#include "../rlhk_chunk.h"
+#include "../rlhk_level.h"
+
+#include <math.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_SECONDS 0.25
+#define BATCH_AGENTS 256
+#define BATCH_GOALS  8
+#define BATCH_STEPS  32
+#define WORKERS      4
+#define FIELDS       12
+#define NOISES       16
+#define TORCHES      100
+#define ACTORS       50000L
+#define ENTITIES     4096L
+#define SPACE_SIZE   256
+#define NORM_BINS    64
+#define LOOT         256
+#define NORM_SAMPLES (1L << 21)
+#define CHUNK_SLOTS  64
+#define LEVEL_SIZE   1024
+#define LEVEL_FILE   "rlhk-bench-level.tmp"
+
+enum map_kind {MAP_OPEN, MAP_MAZE, MAP_CAVE, MAP_ROOMS};
+static const char *map_names[] = {"open", "maze", "cave", "rooms"};
+
+struct bench_map {
+    int width;
+    int height;
+    unsigned long *walls;
+    long *distance;
+    long *heuristic;
+    char *gradient;
+    unsigned long visible_calls;
+    unsigned long passable_calls;
+    int counting;
+};
+
+static volatile unsigned long sink_total;
+
+static long
+bench_sink(const void *buf, long len)
+{
+    sink_total += len + ((const unsigned char *)buf)[0];
+    return len;
+}
+
+static double
+now(void)
+{
+    return clock() / (double)CLOCKS_PER_SEC;
+}
+
+static void
+report(const char *bench, const char *map, int size,
+       long iterations, double seconds, double nodes)
+{
+    printf("%s\t%s\t%d\t%ld\t%.1f\t%.0f\n", bench, map, size, iterations,
+           seconds * 1e9 / iterations, nodes / seconds);
+}
+
+static int
+is_wall(struct bench_map *m, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= m->width || y >= m->height)
+        return 1;
+    return RLHK_GEN_GET(m->walls, m->width, x, y);
+}
+
+RLHK_ALGO_API
+long
+rlhk_algo_map_call(rlhk_algo_map m,
+                   enum rlhk_algo_map_method method,
+                   int x, int y, long data)
+{
+    long i = (long)y * m->width + x;
+    switch (method) {
+        case RLHK_ALGO_MAP_GET_PASSABLE:
+            if (m->counting)
+                m->passable_calls++;
+            return !is_wall(m, x, y);
+        case RLHK_ALGO_MAP_CLEAR_DISTANCE:
+            for (i = 0; i < (long)m->width * m->height; i++)
+                m->distance[i] = -1;
+            return 0;
+        case RLHK_ALGO_MAP_SET_DISTANCE:
+            return (m->distance[i] = data);
+        case RLHK_ALGO_MAP_GET_DISTANCE:
+            return m->distance[i];
+        case RLHK_ALGO_MAP_SET_HEURISTIC:
+            return (m->heuristic[i] = data);
+        case RLHK_ALGO_MAP_GET_HEURISTIC:
+            return m->heuristic[i];
+        case RLHK_ALGO_MAP_SET_GRADIENT:
+            return (m->gradient[i] = data);
+        case RLHK_ALGO_MAP_MARK_SHORTEST:
+            return m->gradient[i];
+        case RLHK_ALGO_MAP_MARK_VISIBLE:
+            m->visible_calls++;
+            return !is_wall(m, x, y);
+        case RLHK_ALGO_MAP_GET_TRANSPARENT:
+            return !is_wall(m, x, y);
+    }
+    abort();
+}
+
+static void
+map_generate(struct bench_map *m, enum map_kind kind, int size)
+{
+    static unsigned long tmp[2048 * RLHK_GEN_STRIDE(2048)];
+    struct rlhk_gen_ca_rule rule = {
+        RLHK_GEN_CA_ATLEAST(5), RLHK_GEN_CA_ATLEAST(4), 1
+    };
+    unsigned long rng[1] = {0x2f6b1a9dUL};
+    int x, y;
+
+    m->width = m->height = size;
+    switch (kind) {
+        case MAP_OPEN:
+            rlhk_gen_clear(m->walls, size, size, 1);
+            rlhk_gen_carve(m->walls, size, 1, 1, size - 2, size - 2);
+            break;
+        case MAP_MAZE:
+            /* Binary tree maze: every cell opens north or west. */
+            rlhk_gen_clear(m->walls, size, size, 1);
+            for (y = 1; y < size - 1; y += 2) {
+                for (x = 1; x < size - 1; x += 2) {
+                    int north = y > 1 && (x == 1 || rlhk_rand_32(rng) & 1);
+                    RLHK_GEN_CLR(m->walls, size, x, y);
+                    if (north)
+                        RLHK_GEN_CLR(m->walls, size, x, y - 1);
+                    else if (x > 1)
+                        RLHK_GEN_CLR(m->walls, size, x - 1, y);
+                }
+            }
+            break;
+        case MAP_CAVE:
+            rlhk_gen_clear(m->walls, size, size, 0);
+            for (y = 0; y < size; y++)
+                for (x = 0; x < size; x++)
+                    if (rlhk_rand_32(rng) % 100 < 45)
+                        RLHK_GEN_SET(m->walls, size, x, y);
+            rlhk_gen_ca(m->walls, tmp, size, size, &rule, 4);
+            for (y = 0; y < size; y++) {
+                RLHK_GEN_SET(m->walls, size, 0, y);
+                RLHK_GEN_SET(m->walls, size, size - 1, y);
+                RLHK_GEN_SET(m->walls, size, y, 0);
+                RLHK_GEN_SET(m->walls, size, y, size - 1);
+            }
+            break;
+        case MAP_ROOMS:
+            rlhk_gen_bsp(m->walls, size, size, rng, 6, 20);
+            break;
+    }
+}
+
+/* Find the open tile nearest a corner, scanning diagonals. */
+static void
+map_corner(struct bench_map *m, int fromend, int *px, int *py)
+{
+    int s, i;
+    for (s = 0; s < m->width + m->height; s++) {
+        for (i = 0; i <= s; i++) {
+            int x = i;
+            int y = s - i;
+            if (fromend) {
+                x = m->width - 1 - x;
+                y = m->height - 1 - y;
+            }
+            if (!is_wall(m, x, y)) {
+                *px = x;
+                *py = y;
+                return;
+            }
+        }
+    }
+    *px = *py = 1;
+}
+
+/* Pick a random open tile. */
+static void
+map_random(struct bench_map *m, unsigned long *rng, short *px, short *py)
+{
+    do {
+        *px = rlhk_rand_32(rng) % m->width;
+        *py = rlhk_rand_32(rng) % m->height;
+    } while (is_wall(m, *px, *py));
+}
+
+/* Agents spread over the map, sharing a handful of goals. */
+/* Count the passability queries of an untimed pass. */
+static void
+count_begin(struct bench_map *m)
+{
+    m->passable_calls = 0;
+    m->counting = 1;
+}
+
+static double
+count_end(struct bench_map *m)
+{
+    m->counting = 0;
+    return m->passable_calls;
+}
+
+static void
+bench_batch(struct bench_map *m, const char *name, int size,
+            struct rlhk_algo_ctx *ctx)
+{
+    static struct rlhk_algo_query q[BATCH_AGENTS];
+    static short routes[BATCH_AGENTS][BATCH_STEPS * 2];
+    static long order[BATCH_AGENTS];
+    static long length[BATCH_AGENTS];
+    unsigned long rng[1] = {0x5d1c3e7bUL};
+    double tw[WORKERS] = {0};
+    long answered[WORKERS] = {0};
+    long total = 0;
+    long n, i;
+    double start, t = 0;
+    int w;
+
+    for (i = 0; i < BATCH_AGENTS; i++) {
+        map_random(m, rng, &q[i].x0, &q[i].y0);
+        if (i < BATCH_GOALS) {
+            map_random(m, rng, &q[i].x1, &q[i].y1);
+        } else {
+            q[i].x1 = q[i % BATCH_GOALS].x1;
+            q[i].y1 = q[i % BATCH_GOALS].y1;
+        }
+        q[i].route = routes[i];
+        q[i].max = BATCH_STEPS;
+    }
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        rlhk_algo_batch_plan(q, BATCH_AGENTS, order);
+        rlhk_algo_shortest_batch(ctx, m, q, order, BATCH_AGENTS, 0, 1);
+    }
+    count_begin(m);
+    rlhk_algo_shortest_batch(ctx, m, q, order, BATCH_AGENTS, 0, 1);
+    report("shortest_batch", name, size, n, t, count_end(m) * n);
+    for (i = 0; i < BATCH_AGENTS; i++)
+        length[i] = q[i].length;
+
+    /* The same batch split between workers, run one after another to
+     * time each worker's share. The nodes are the queries it answers.
+     */
+    t = 0;
+    for (n = 0; !n || t < MIN_SECONDS; n++) {
+        rlhk_algo_batch_plan(q, BATCH_AGENTS, order);
+        for (w = 0; w < WORKERS; w++) {
+            double dt;
+            start = now();
+            rlhk_algo_shortest_batch(ctx, m, q, order, BATCH_AGENTS,
+                                     w, WORKERS);
+            dt = now() - start;
+            tw[w] += dt;
+            t += dt;
+        }
+    }
+    for (w = 0; w < WORKERS; w++) {
+        char label[32];
+        for (i = 0; i < BATCH_AGENTS; i++)
+            q[i].length = -3;
+        rlhk_algo_shortest_batch(ctx, m, q, order, BATCH_AGENTS, w, WORKERS);
+        for (i = 0; i < BATCH_AGENTS; i++) {
+            if (q[i].length == -3)
+                continue;
+            if (q[i].length != length[i]) {
+                fprintf(stderr, "shortest_batch: worker %d disagrees\n", w);
+                abort();
+            }
+            answered[w]++;
+            total++;
+        }
+        sprintf(label, "shortest_batch_%d/%d", w, WORKERS);
+        report(label, name, size, n, tw[w], (double)answered[w] * n);
+    }
+    if (total != BATCH_AGENTS) {
+        fprintf(stderr, "shortest_batch: %ld queries answered\n", total);
+        abort();
+    }
+}
+
+/* A cheap fingerprint of a distance grid. */
+static unsigned long
+grid_hash(const rlhk_algo_i32 *distance, long n)
+{
+    unsigned long h = 0;
+    long i;
+    for (i = 0; i < n; i++)
+        h = (h * 31 + (unsigned long)distance[i]) & 0xffffffffUL;
+    return h;
+}
+
+/* A turn's worth of distance fields, one random seed each. */
+static void
+bench_many(struct bench_map *m, const char *name, int size,
+           void *buf, long buflen, rlhk_algo_i32 *distance)
+{
+    struct rlhk_algo_field fields[FIELDS];
+    struct rlhk_algo_field check[FIELDS];
+    short seeds[FIELDS][2];
+    unsigned long hash[FIELDS];
+    double reached[FIELDS];
+    unsigned long rng[1] = {0x1b873593UL};
+    long tiles = (long)size * size;
+    rlhk_algo_i32 *other = malloc(sizeof(rlhk_algo_i32) * tiles);
+    double tw[WORKERS] = {0};
+    long n;
+    int i, w;
+    double start, t = 0, total = 0;
+
+    if (!other)
+        abort();
+
+    /* One thread, so every field may share the same output grid. */
+    for (i = 0; i < FIELDS; i++) {
+        map_random(m, rng, &seeds[i][0], &seeds[i][1]);
+        fields[i].seeds = seeds[i];
+        fields[i].nseeds = 1;
+        fields[i].distance = distance;
+    }
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        rlhk_algo_dijkstra_many(m->walls, size, size, fields, FIELDS,
+                                buf, buflen, 0, 1);
+
+    /* Each field expands every tile it reaches. */
+    for (i = 0; i < FIELDS; i++) {
+        long j;
+        rlhk_algo_dijkstra_many(m->walls, size, size, fields + i, 1,
+                                buf, buflen, 0, 1);
+        reached[i] = 0;
+        for (j = 0; j < tiles; j++)
+            reached[i] += distance[j] >= 0;
+        total += reached[i];
+        hash[i] = grid_hash(distance, tiles);
+    }
+    report("dijkstra_many", name, size, n, t, total * n);
+
+    /* The same fields split between workers, run one after another to
+     * time each worker's share.
+     */
+    t = 0;
+    for (n = 0; !n || t < MIN_SECONDS; n++) {
+        for (w = 0; w < WORKERS; w++) {
+            double dt;
+            start = now();
+            rlhk_algo_dijkstra_many(m->walls, size, size, fields, FIELDS,
+                                    buf, buflen, w, WORKERS);
+            dt = now() - start;
+            tw[w] += dt;
+            t += dt;
+        }
+    }
+
+    /* Each field computed by its worker, alongside seedless fields
+     * writing elsewhere, must match the single-worker field.
+     */
+    for (i = 0; i < FIELDS; i++) {
+        long j;
+        for (j = 0; j < tiles; j++)
+            distance[j] = -2;
+        for (j = 0; j < FIELDS; j++) {
+            check[j].seeds = seeds[j];
+            check[j].nseeds = 0;
+            check[j].distance = other;
+        }
+        check[i].nseeds = 1;
+        check[i].distance = distance;
+        for (w = 0; w < WORKERS; w++)
+            rlhk_algo_dijkstra_many(m->walls, size, size, check, FIELDS,
+                                    buf, buflen, w, WORKERS);
+        if (grid_hash(distance, tiles) != hash[i]) {
+            fprintf(stderr, "dijkstra_many: field %d differs\n", i);
+            abort();
+        }
+    }
+    for (w = 0; w < WORKERS; w++) {
+        char label[32];
+        double nodes = 0;
+        for (i = w; i < FIELDS; i += WORKERS)
+            nodes += reached[i];
+        sprintf(label, "dijkstra_many_%d/%d", w, WORKERS);
+        report(label, name, size, n, tw[w], nodes * n);
+    }
+    free(other);
+}
+
+/* Steady noise from a few sources spreading over the whole map. */
+static void
+bench_diffuse(struct bench_map *m, const char *name, int size,
+              void *buf, float *keep)
+{
+    struct rlhk_algo_diffuse d[1];
+    short sources[NOISES][2];
+    unsigned long rng[1] = {0x7c3a91e5UL};
+    double start, t = 0, tiles = 0;
+    long n, i;
+    int x, y;
+
+    for (y = 0; y < size; y++)
+        for (x = 0; x < size; x++)
+            keep[(long)y * size + x] = is_wall(m, x, y) ? 0.0f : 0.99f;
+    for (i = 0; i < NOISES; i++)
+        map_random(m, rng, &sources[i][0], &sources[i][1]);
+    if (!rlhk_algo_diffuse_init(d, size, size, buf,
+                                RLHK_ALGO_DIFFUSE_BUFLEN(size, size)))
+        abort();
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        for (i = 0; i < NOISES; i++)
+            rlhk_algo_diffuse_add(d, sources[i][0], sources[i][1], 1);
+        tiles += (d->x1 - d->x0 + 3.0) * (d->y1 - d->y0 + 3);
+        rlhk_algo_diffuse_step(d, keep, 0.5f, 1e-6f);
+    }
+    report("diffuse", name, size, n, t, tiles);
+}
+
+/* Static torches plus a player's light wandering the map. */
+static void
+bench_light(struct bench_map *m, const char *name, int size,
+            rlhk_algo_i32 *buf)
+{
+    static struct rlhk_light lights[TORCHES + 1];
+    static unsigned char sets[TORCHES + 1][RLHK_ALGO_FOV_SETLEN(12)];
+    struct rlhk_light_map map[1];
+    struct rlhk_light *player = lights + TORCHES;
+    unsigned long rng[1] = {0x3c6ef372UL};
+    double start, t = 0, sources = 0;
+    long n, i;
+
+    rlhk_light_map_init(map, size, size, buf);
+    for (i = 0; i <= TORCHES; i++) {
+        short x, y;
+        map_random(m, rng, &x, &y);
+        rlhk_light_init(lights + i, x, y, i < TORCHES ? 6 : 12, sets[i]);
+        lights[i].color[0] = 255;
+        lights[i].color[1] = 160;
+        lights[i].color[2] = 64;
+    }
+    rlhk_light_update(map, m, lights, TORCHES + 1);
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        int d = rlhk_rand_32(rng) % 8;
+        int x = player->x + RLHK_ALGO_DX(d);
+        int y = player->y + RLHK_ALGO_DY(d);
+        if (!is_wall(m, x, y))
+            rlhk_light_move(player, x, y);
+        sources += rlhk_light_update(map, m, lights, TORCHES + 1);
+    }
+    report("light", name, size, n, t, sources);
+}
+
+static void
+bench_algo(struct bench_map *m, const char *name, int size,
+           short *buf, long buflen, struct rlhk_algo_ctx *ctx,
+           void *scratch, rlhk_algo_i32 *distance, float *keep)
+{
+    static long fovbuf[RLHK_ALGO_FOV_CACHE_BUFLEN(4, 16) / sizeof(long) + 1];
+    struct rlhk_algo_fov_cache fovcache[1];
+    int x0, y0, x1, y1, cx, cy;
+    short seed[2];
+    long n;
+    double start, t = 0;
+
+    map_corner(m, 0, &x0, &y0);
+    map_corner(m, 1, &x1, &y1);
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        rlhk_algo_shortest(m, x0, y0, x1, y1, buf, buflen);
+    count_begin(m);
+    rlhk_algo_shortest(m, x0, y0, x1, y1, buf, buflen);
+    report("shortest", name, size, n, t, count_end(m) * n);
+
+    seed[0] = x0;
+    seed[1] = y0;
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        long i = rlhk_algo_buf_push(buf, buflen, 0, x0, y0);
+        rlhk_algo_dijkstra(m, buf, buflen, i);
+    }
+    count_begin(m);
+    rlhk_algo_dijkstra(m, buf, buflen, rlhk_algo_buf_push(buf, buflen, 0,
+                                                          x0, y0));
+    report("dijkstra", name, size, n, t, count_end(m) * n);
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        rlhk_algo_shortest_r(ctx, m, x0, y0, x1, y1);
+    count_begin(m);
+    rlhk_algo_shortest_r(ctx, m, x0, y0, x1, y1);
+    report("shortest_r", name, size, n, t, count_end(m) * n);
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        rlhk_algo_dijkstra_r(ctx, m, seed, 1);
+    count_begin(m);
+    rlhk_algo_dijkstra_r(ctx, m, seed, 1);
+    report("dijkstra_r", name, size, n, t, count_end(m) * n);
+
+    bench_batch(m, name, size, ctx);
+    bench_many(m, name, size, scratch,
+               RLHK_ALGO_MANY_BUFLEN(size, size), distance);
+    bench_diffuse(m, name, size, scratch, keep);
+    bench_light(m, name, size, scratch);
+
+    /* Viewer on the open tile nearest the center. */
+    cx = cy = size / 2;
+    while (is_wall(m, cx, cy) && cx < size - 1)
+        cx++;
+    m->visible_calls = 0;
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        rlhk_algo_fov(m, cx, cy, 16);
+    report("fov", name, size, n, t, m->visible_calls);
+
+    /* Same viewer pacing between two tiles, replayed from the cache. */
+    rlhk_algo_fov_cache_init(fovcache, 4, 16, fovbuf, sizeof(fovbuf));
+    m->visible_calls = 0;
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        int x = cx + (n & 1 && !is_wall(m, cx - 1, cy) ? -1 : 0);
+        const unsigned char *set =
+            rlhk_algo_fov_cached(fovcache, m, x, cy, 16, 0);
+        rlhk_algo_fov_replay(m, set, x, cy, 16);
+    }
+    report("fov_cached", name, size, n, t, m->visible_calls);
+}
+
+static void
+bench_gen(int size)
+{
+    static unsigned long a[2048 * RLHK_GEN_STRIDE(2048)];
+    static unsigned long b[2048 * RLHK_GEN_STRIDE(2048)];
+    static short noise[2048 * 2048];
+    static long pbuf[RLHK_GEN_POISSON_BUFLEN(2048, 2048, 4) / sizeof(long)];
+    static short spawn[RLHK_GEN_POISSON_BUFLEN(2048, 2048, 4) /
+                       sizeof(long)];
+    struct rlhk_gen_ca_rule rule = {
+        RLHK_GEN_CA_ATLEAST(5), RLHK_GEN_CA_ATLEAST(4), 1
+    };
+    unsigned long rng[1] = {0x2f6b1a9dUL};
+    double start, t = 0, spawns = 0;
+    long n;
+
+    rlhk_gen_clear(a, size, size, 0);
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        rlhk_gen_ca(a, b, size, size, &rule, 1);
+    report("gen_ca", "cave", size, n, t, (double)size * size * n);
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        rlhk_gen_bsp(a, size, size, rng, 6, 20);
+    report("gen_bsp", "rooms", size, n, t, 0);
+
+    /* Monsters at least 4 tiles apart in the last dungeon. */
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        spawns += rlhk_gen_poisson(a, size, size, 4, 30, rng, spawn,
+                                   sizeof(spawn) / sizeof(*spawn) / 2,
+                                   pbuf, sizeof(pbuf));
+    report("gen_poisson", "rooms", size, n, t, spawns);
+
+    /* Six octaves of terrain from 64-tile lattice cells. */
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        rlhk_gen_noise(noise, size, size, 0, 0, 6, 6, n);
+    report("gen_noise", "-", size, n, t, (double)size * size * n);
+    sink_total += noise[n % size];
+}
+
+/* The polar method rlhk_rand_norm() used before the Ziggurat. */
+static void
+norm_polar(unsigned long *s, double *n0, double *n1)
+{
+    double x0, x1, w;
+    do {
+        x0 = 2 * rlhk_rand_uniform(s) - 1;
+        x1 = 2 * rlhk_rand_uniform(s) - 1;
+        w = x0 * x0 + x1 * x1;
+    } while (w >= 1);
+    w = sqrt((-2.0 * log(w)) / w);
+    *n0 = x0 * w;
+    *n1 = x1 * w;
+}
+
+static void
+norm_bin(unsigned long *bins, double v)
+{
+    int b = (int)floor((v + 4.0) * NORM_BINS / 8.0);
+    b = b < 0 ? 0 : b >= NORM_BINS ? NORM_BINS + 1 : b + 1;
+    bins[b]++;
+}
+
+/* Two-sample chi-squared test of rlhk_rand_norm() against the polar
+ * method, binned over [-4, 4] plus both tails. Aborts on a mismatch.
+ */
+static void
+norm_check(void)
+{
+    unsigned long a[NORM_BINS + 2] = {0};
+    unsigned long b[NORM_BINS + 2] = {0};
+    unsigned long rng[1] = {0x7b1d3c55UL};
+    double chi2 = 0;
+    long i;
+
+    for (i = 0; i < NORM_SAMPLES; i++) {
+        double n0, n1;
+        rlhk_rand_norm(rng, &n0, &n1);
+        norm_bin(a, n0);
+        norm_bin(a, n1);
+        norm_polar(rng, &n0, &n1);
+        norm_bin(b, n0);
+        norm_bin(b, n1);
+    }
+    for (i = 0; i < NORM_BINS + 2; i++)
+        if (a[i] + b[i])
+            chi2 += ((double)a[i] - b[i]) * ((double)a[i] - b[i]) /
+                    (a[i] + b[i]);
+    /* Far beyond the 99.99th percentile for NORM_BINS + 1 degrees. */
+    if (chi2 > 2.0 * NORM_BINS + 50) {
+        fprintf(stderr, "rand_norm: chi-squared %.1f vs polar\n", chi2);
+        abort();
+    }
+}
+
+/* A fresh context must report no data, whatever its buffer held. */
+static void
+ctx_check(struct rlhk_algo_ctx *ctx, int size)
+{
+    short route[2 * 8];
+    int i;
+    for (i = 0; i < size; i += 7) {
+        if (rlhk_algo_ctx_distance(ctx, i, i) != -1 ||
+            rlhk_algo_ctx_gradient(ctx, i, size - 1 - i) != -1 ||
+            rlhk_algo_ctx_route(ctx, size - 1 - i, i, route, 8) != 0) {
+            fprintf(stderr, "ctx: data before any query at %d\n", i);
+            abort();
+        }
+    }
+}
+
+static void
+bench_rand(void)
+{
+    unsigned long rng[1] = {0x2f6b1a9dUL};
+    double start, t = 0, sum = 0;
+    long n, i;
+
+    norm_check();
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        for (i = 0; i < 4096; i++) {
+            double n0, n1;
+            rlhk_rand_norm(rng, &n0, &n1);
+            sum += n0 + n1;
+        }
+    }
+    report("rand_norm", "-", 0, n * 4096, t, 0);
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        for (i = 0; i < 4096; i++) {
+            double n0, n1;
+            norm_polar(rng, &n0, &n1);
+            sum += n0 + n1;
+        }
+    }
+    report("rand_norm_polar", "-", 0, n * 4096, t, 0);
+
+    /* Dice rolls of assorted sizes. */
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        for (i = 0; i < 4096; i++)
+            sum += rlhk_rand_range(rng, 2 + (i & 31));
+    report("rand_range", "-", 0, n * 4096, t, 0);
+    sink_total += sum > 0;
+}
+
+/* The scalar generators, then bulk generation. */
+static void
+bench_fill(void)
+{
+    static rlhk_rand_u32 u[4096];
+    static double d[4096];
+    rlhk_rand_u32 lanes[RLHK_RAND_LANES];
+    rlhk_rand_u32 xoshiro[4];
+    unsigned long rng[1] = {0x68e31da4UL};
+    unsigned long sum = 0;
+    double start, t = 0;
+    long n, i;
+
+    rlhk_rand_fill_seed(rng, lanes);
+    rlhk_rand_xoshiro_seed(xoshiro, 0x68e31da4UL);
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        for (i = 0; i < 4096; i++)
+            sum += rlhk_rand_32(rng);
+    report("rand_32", "-", 0, n * 4096, t, 0);
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        for (i = 0; i < 4096; i++)
+            sum += rlhk_rand_xoshiro(xoshiro);
+    report("rand_xoshiro", "-", 0, n * 4096, t, 0);
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        rlhk_rand_fill_u32(lanes, u, 4096);
+        sum += u[n & 4095];
+    }
+    report("rand_fill_u32", "-", 0, n * 4096, t, 0);
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        rlhk_rand_fill_uniform(lanes, d, 4096);
+        sum += d[n & 4095] > 0.5;
+    }
+    report("rand_fill_uniform", "-", 0, n * 4096, t, 0);
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        rlhk_rand_fill_norm(lanes, d, 4096);
+        sum += d[n & 4095] > 0;
+    }
+    report("rand_fill_norm", "-", 0, n * 4096, t, 0);
+
+    /* A 64x64 chunk of per-tile values, tile by tile then by row. */
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        for (i = 0; i < 4096; i++)
+            sum += rlhk_rand_at(n, i & 63, i >> 6, 1);
+    report("rand_at", "-", 64, n * 4096, t, 0);
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        for (i = 0; i < 64; i++)
+            rlhk_rand_at_row(n, 0, i, 1, u + i * 64, 64);
+        sum += u[n & 4095];
+    }
+    report("rand_at_row", "-", 64, n * 4096, t, 0);
+    sink_total += sum;
+}
+
+/* Seeding a 32-bit generator from system entropy. */
+static void
+bench_entropy(void)
+{
+    unsigned long seed = 0;
+    double start, t = 0;
+    long n, i;
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        for (i = 0; i < 256; i++)
+            if (!rlhk_rand_entropy(&seed, 4))
+                abort();
+    report("rand_entropy", "-", 4, n * 256, t, n * 256.0);
+    sink_total += seed & 1;
+}
+
+/* A loot table: build it, then draw from it. */
+static void
+bench_alias(void)
+{
+    static double buf[RLHK_RAND_ALIAS_BUFLEN(LOOT) / sizeof(double) + 1];
+    static double weights[LOOT];
+    struct rlhk_rand_alias alias[1];
+    unsigned long rng[1] = {0x5bd1e995UL};
+    unsigned long sum = 0;
+    double start, t = 0;
+    long n, i;
+
+    if (!rlhk_rand_alias_init(alias, LOOT, buf, sizeof(buf)))
+        abort();
+    for (i = 0; i < LOOT; i++)
+        weights[i] = 1 + rlhk_rand_range(rng, 1000);
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        rlhk_rand_alias_build(alias, weights);
+    report("rand_alias_build", "-", LOOT, n, t, 0);
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++)
+        for (i = 0; i < 4096; i++)
+            sum += rlhk_rand_alias_draw(alias, rng);
+    report("rand_alias_draw", "-", LOOT, n * 4096, t, 0);
+    sink_total += sum;
+}
+
+/* Actors with assorted speeds taking turns in due batches. */
+static void
+bench_sched(void)
+{
+    static struct rlhk_sched_node nodes[ACTORS];
+    static long due[ACTORS];
+    struct rlhk_sched sched[1];
+    unsigned long rng[1] = {0x9e3779b9UL};
+    double start, t = 0, actors = 0;
+    long n, i;
+
+    rlhk_sched_init(sched, nodes, ACTORS);
+    for (i = 0; i < ACTORS; i++)
+        rlhk_sched_at(sched, i, rlhk_rand_32(rng) % 100);
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        long count = rlhk_sched_due(sched, due, ACTORS);
+        for (i = 0; i < count; i++) {
+            unsigned long speed = 50 + due[i] % 100;
+            rlhk_sched_at(sched, due[i], sched->now + speed);
+        }
+        actors += count;
+    }
+    report("sched_due", "-", ACTORS, n, t, actors);
+}
+
+static void
+bench_space(void)
+{
+    static struct rlhk_space_node nodes[ENTITIES];
+    static long buf[RLHK_SPACE_BUFLEN(SPACE_SIZE, SPACE_SIZE) /
+                    sizeof(long) + 1];
+    static long found[ENTITIES];
+    struct rlhk_space space[1];
+    unsigned long rng[1] = {0x2545f491UL};
+    double start, t = 0, entities = 0;
+    long n, i;
+
+    if (!rlhk_space_init(space, SPACE_SIZE, SPACE_SIZE, nodes, ENTITIES,
+                         buf, sizeof(buf)))
+        abort();
+    for (i = 0; i < ENTITIES; i++)
+        rlhk_space_place(space, i, rlhk_rand_32(rng) % SPACE_SIZE,
+                         rlhk_rand_32(rng) % SPACE_SIZE);
+
+    /* Every entity takes a random step. */
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        for (i = 0; i < ENTITIES; i++) {
+            int x = nodes[i].x + (int)(rlhk_rand_32(rng) % 3) - 1;
+            int y = nodes[i].y + (int)(rlhk_rand_32(rng) % 3) - 1;
+            rlhk_space_place(space, i, x, y);
+        }
+        entities += ENTITIES;
+    }
+    report("space_move", "-", SPACE_SIZE, n, t, entities);
+
+    /* Every entity looks for its neighbours. */
+    entities = 0;
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        for (i = 0; i < ENTITIES; i++)
+            entities += rlhk_space_radius(space, nodes[i].x, nodes[i].y, 8,
+                                          found, ENTITIES);
+    }
+    report("space_radius", "-", SPACE_SIZE, n, t, entities);
+}
+
+struct bench_world {
+    unsigned long loaded;
+};
+
+RLHK_CHUNK_API
+long
+rlhk_chunk_call(rlhk_chunk_world w, enum rlhk_chunk_method method,
+                long cx, long cy, long slot)
+{
+    (void)cx;
+    (void)cy;
+    (void)slot;
+    switch (method) {
+        case RLHK_CHUNK_LOAD:
+            return 0;
+        case RLHK_CHUNK_GENERATE:
+            w->loaded++;
+            return 1;
+        case RLHK_CHUNK_EVICT:
+        case RLHK_CHUNK_CLEAR:
+            return 0;
+    }
+    abort();
+}
+
+/* An explorer wandering east across an unbounded chunked world. */
+static void
+bench_chunk(void)
+{
+    static long buf[(sizeof(struct rlhk_chunk_slot) + sizeof(long) * 4) *
+                    CHUNK_SLOTS / sizeof(long)];
+    struct rlhk_chunk_cache cache[1];
+    struct bench_world world[1];
+    unsigned long rng[1] = {0x6c078965UL};
+    double start, t = 0;
+    long cx = 0, cy = 0;
+    long sum = 0;
+    long n, i;
+    int lx, ly;
+    int x = 0, y = 0;
+
+    if (!rlhk_chunk_init(cache, CHUNK_SLOTS, buf, sizeof(buf)))
+        abort();
+    world->loaded = 0;
+
+    /* Each step looks at the tile ahead, as a move would. */
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        for (i = 0; i < 4096; i++) {
+            x += rlhk_rand_32(rng) % 4 != 0;
+            y += (int)(rlhk_rand_32(rng) % 3) - 1;
+            sum += rlhk_chunk_locate(cache, world, cx, cy, x, y, &lx, &ly);
+        }
+        /* Keep the explorer's coordinates relative to a nearby chunk. */
+        rlhk_chunk_locate(cache, world, cx, cy, x, y, &lx, &ly);
+        cx = cache->slots[cache->last].cx;
+        cy = cache->slots[cache->last].cy;
+        x = lx;
+        y = ly;
+    }
+    report("chunk_locate", "-", CHUNK_SLOTS, n * 4096, t, world->loaded);
+
+    /* A search touching scratch in the 3x3 chunks around the origin. */
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        rlhk_chunk_epoch(cache);
+        for (i = 0; i < 4096; i++) {
+            x = (int)(rlhk_rand_32(rng) % (3 * RLHK_CHUNK_SIZE)) -
+                RLHK_CHUNK_SIZE;
+            y = (int)(rlhk_rand_32(rng) % (3 * RLHK_CHUNK_SIZE)) -
+                RLHK_CHUNK_SIZE;
+            sum += rlhk_chunk_scratch(cache, world, cx, cy, x, y, &lx, &ly);
+        }
+    }
+    report("chunk_scratch", "-", CHUNK_SLOTS, n * 4096, t, 0);
+    rlhk_chunk_flush(cache, world);
+    sink_total += sum;
+}
+
+/* A prebuilt level saved to disk, then mapped and read in place. */
+static void
+bench_level(void)
+{
+    long size = rlhk_level_size(LEVEL_SIZE, LEVEL_SIZE);
+    void *image = malloc(size);
+    struct rlhk_level level[1];
+    unsigned long rng[1] = {0x1b873593UL};
+    double start, t = 0;
+    long sum = 0;
+    long n, i;
+    int x, y;
+    char path[1024];
+    const char *dir = getenv("TMPDIR");
+
+    /* Keep the level file out of the working directory. */
+    if (!dir || !*dir || strlen(dir) > sizeof(path) - sizeof(LEVEL_FILE) - 1)
+        dir = "/tmp";
+    sprintf(path, "%s/%s", dir, LEVEL_FILE);
+
+    if (!image || !rlhk_level_format(image, size, LEVEL_SIZE, LEVEL_SIZE))
+        abort();
+    for (y = 0; y < LEVEL_SIZE; y++) {
+        for (x = 0; x < LEVEL_SIZE; x++) {
+            int pass = rlhk_rand_32(rng) % 4 != 0;
+            rlhk_level_set(image, RLHK_LEVEL_PASSABLE, x, y, pass);
+            rlhk_level_set(image, RLHK_LEVEL_TRANSPARENT, x, y, pass);
+        }
+    }
+    if (!rlhk_level_save(path, image))
+        abort();
+
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        if (!rlhk_level_open(level, path))
+            abort();
+        sum += rlhk_level_passable(level, n % LEVEL_SIZE, 0);
+        rlhk_level_close(level);
+    }
+    report("level_open", "-", LEVEL_SIZE, n, t, 0);
+
+    /* Random probes, as from rlhk_algo_map_call(). */
+    if (!rlhk_level_open(level, path))
+        abort();
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        for (i = 0; i < 4096; i++) {
+            x = rlhk_rand_32(rng) % LEVEL_SIZE;
+            y = rlhk_rand_32(rng) % LEVEL_SIZE;
+            sum += rlhk_level_passable(level, x, y) +
+                   rlhk_level_transparent(level, x, y);
+        }
+    }
+    report("level_read", "-", LEVEL_SIZE, n * 4096, t, n * 8192.0);
+    rlhk_level_close(level);
+
+    remove(path);
+    free(image);
+    sink_total += sum;
+}
+
+static void
+bench_tui(int width, int height)
+{
+    double start, t = 0;
+    long n;
+    int x, y;
+
+    /* Output goes to bench_sink() and terminal modes are never set,
+     * so the terminal is left alone even if the bench is interrupted.
+     * Without a terminal, the display size is still set. */
+    rlhk_tui_init(width, height);
+
+    /* Every cell changes on every flush. */
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        for (y = 0; y < height; y++)
+            for (x = 0; x < width; x++)
+                rlhk_tui_putc(x, y, 'a' + (x + y + n) % 26, n & 0xff);
+        rlhk_tui_flush();
+    }
+    report("tui_flush_full", "-", width * height, n, t, 0);
+
+    /* A single cell changes on every flush. */
+    start = now();
+    for (n = 0; !n || (t = now() - start) < MIN_SECONDS; n++) {
+        rlhk_tui_putc(width / 2, height / 2, 'a' + n % 26, 0x07);
+        rlhk_tui_flush();
+    }
+    report("tui_flush_one", "-", width * height, n, t, 0);
+
+    rlhk_tui_release();
+}
+
+int
+main(void)
+{
+    static const int sizes[] = {64, 256, 1024, 2048};
+    struct bench_map m[1];
+    struct rlhk_algo_ctx ctx[1];
+    long maxtiles = 2048L * 2048;
+    long buflen = sizeof(short) * maxtiles * 4;
+    short *buf = malloc(buflen);
+    void *ctxbuf = 0;
+    long lightlen = sizeof(rlhk_algo_i32) * maxtiles * RLHK_LIGHT_CHANNELS;
+    long difflen = RLHK_ALGO_DIFFUSE_BUFLEN(2048, 2048);
+    long scratchlen = RLHK_ALGO_MANY_BUFLEN(2048, 2048);
+    void *scratch;
+    float *keep = malloc(sizeof(float) * maxtiles);
+    rlhk_algo_i32 *distance = malloc(sizeof(rlhk_algo_i32) * maxtiles);
+    int k, s;
+
+    /* One scratch buffer serves each of the benchmarks that need one. */
+    scratchlen = scratchlen > difflen ? scratchlen : difflen;
+    scratchlen = scratchlen > lightlen ? scratchlen : lightlen;
+    scratch = malloc(scratchlen);
+
+    m->walls = malloc(sizeof(unsigned long) * 2048 * RLHK_GEN_STRIDE(2048));
+    m->distance = malloc(sizeof(long) * maxtiles);
+    m->heuristic = malloc(sizeof(long) * maxtiles);
+    m->gradient = malloc(maxtiles);
+    m->counting = 0;
+    if (!buf || !scratch || !distance || !keep ||
+        !m->walls || !m->distance || !m->heuristic || !m->gradient)
+        return 1;
+
+    printf("bench\tmap\tsize\titerations\tns/op\tnodes/sec\n");
+    for (s = 0; s < (int)(sizeof(sizes) / sizeof(*sizes)); s++) {
+        long ctxlen = RLHK_ALGO_CTX_BUFLEN(sizes[s], sizes[s]);
+        free(ctxbuf);
+        ctxbuf = malloc(ctxlen);
+        if (!ctxbuf)
+            return 1;
+        memset(ctxbuf, 0x5a, ctxlen);
+        if (!rlhk_algo_ctx_init(ctx, 0, 0, sizes[s], sizes[s], ctxbuf, ctxlen))
+            return 1;
+        ctx_check(ctx, sizes[s]);
+        for (k = MAP_OPEN; k <= MAP_ROOMS; k++) {
+            map_generate(m, k, sizes[s]);
+            bench_algo(m, map_names[k], sizes[s], buf, buflen, ctx,
+                       scratch, distance, keep);
+        }
+        bench_gen(sizes[s]);
+    }
+    bench_rand();
+    bench_fill();
+    bench_alias();
+    bench_entropy();
+    bench_sched();
+    bench_space();
+    bench_chunk();
+    bench_level();
+    bench_tui(80, 25);
+    bench_tui(200, 60);
+
+    free(ctxbuf);
+    free(keep);
+    free(distance);
+    free(scratch);
+    free(m->gradient);
+    free(m->heuristic);
+    free(m->distance);
+    free(m->walls);
+    free(buf);
+    return !sink_total;
+}
@@ -5,6 +5,7 @@ typedef int rlhk_algo_map;
 #include "../rlhk_tui.h"
 #include "../rlhk_rand.h"
 #include "../rlhk_algo.h"
+#include "../rlhk_gen.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -13,6 +14,10 @@ static int width;
 static int height;
 static int fov_radius = 12;
 
+#define FOV_MAX_RADIUS 32
+#define FOV_CACHE_SIZE 8
+#define FOV_DELTA_MAX  1024
+
 #define TILE_EMPTY_C   RLHK_TUI_FULL_STOP
 #define TILE_EMPTY_A   (RLHK_TUI_FR | RLHK_TUI_FG | RLHK_TUI_FB)
 #define TILE_DIRT_C    RLHK_TUI_MEDIUM_SHADE
@@ -22,7 +27,7 @@ static int fov_radius = 12;
 #define TILE_PLAYER_C  RLHK_TUI_COMMERCIAL_AT
 #define TILE_PLAYER_A  (RLHK_TUI_FR | RLHK_TUI_FB | RLHK_TUI_FH)
 
-static char game_map[2][RLHK_TUI_MAX_HEIGHT][RLHK_TUI_MAX_WIDTH];
+static char game_map[RLHK_TUI_MAX_HEIGHT][RLHK_TUI_MAX_WIDTH];
 static char map_marked[RLHK_TUI_MAX_HEIGHT][RLHK_TUI_MAX_WIDTH];
 static char map_visible[RLHK_TUI_MAX_HEIGHT][RLHK_TUI_MAX_WIDTH];
 static char map_route[RLHK_TUI_MAX_HEIGHT][RLHK_TUI_MAX_WIDTH];
@@ -42,13 +47,18 @@ static long map_heuristic[RLHK_TUI_MAX_HEIGHT][RLHK_TUI_MAX_WIDTH];
 static void
 map_generate(void)
 {
+    static unsigned long cave[2][RLHK_TUI_MAX_HEIGHT *
+                                 RLHK_GEN_STRIDE(RLHK_TUI_MAX_WIDTH)];
+    struct rlhk_gen_ca_rule smooth = {
+        RLHK_GEN_CA_ATLEAST(7), RLHK_GEN_CA_ATLEAST(7), 1
+    };
     unsigned long rng[1];
     int x, y, i;
 
     if (!rlhk_rand_entropy(rng, 4))
         abort();
 
-    memset(game_map, 1, sizeof(game_map));
+    rlhk_gen_clear(cave[0], width, height, 1);
     for (i = 0; i < width * height / 4; i++) {
         double nx, ny;
         int x, y;
@@ -56,60 +66,70 @@ map_generate(void)
         x = nx * width / 6 + width / 2;
         y = ny * height / 6 + height / 2;
         if (IN_BOUNDS(x, y))
-            game_map[1][y][x] = 0;
+            RLHK_GEN_CLR(cave[0], width, x, y);
     }
+    rlhk_gen_ca(cave[0], cave[1], width, height, &smooth, 1);
+
+    for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+            game_map[y][x] = ON_BORDER(x, y) ||
+                             RLHK_GEN_GET(cave[0], width, x, y);
+}
+
+static int draw_dijkstra;
 
-    for (i = 1; i < 3; i++) {
-        for (y = 1; y < height - 1; y++) {
-            for (x = 1; x < width - 1; x++) {
-                int sum = 
-                    game_map[i % 2][y - 1][x + 1] +
-                    game_map[i % 2][y - 1][x + 0] +
-                    game_map[i % 2][y - 1][x - 1] +
-                    game_map[i % 2][y + 0][x + 1] +
-                    game_map[i % 2][y + 0][x - 1] +
-                    game_map[i % 2][y + 1][x + 1] +
-                    game_map[i % 2][y + 1][x + 0] +
-                    game_map[i % 2][y + 1][x - 1];
-                game_map[(i + 1) % 2][y][x] = sum > 6;
+static void
+tile_draw(int x, int y)
+{
+    unsigned visible = map_visible[y][x] ? RLHK_TUI_FH : 0;
+    if (ON_BORDER(x, y))
+        rlhk_tui_putc(x, y, TILE_WALL_C, TILE_WALL_A | visible);
+    else if (game_map[y][x])
+        rlhk_tui_putc(x, y, TILE_DIRT_C, TILE_DIRT_A | visible);
+    else {
+        unsigned mark = map_marked[y][x] ? RLHK_TUI_BR : 0;
+        unsigned c = visible ? TILE_EMPTY_C : ' ';
+        mark |= visible;
+        if (!draw_dijkstra) {
+            rlhk_tui_putc(x, y, c, TILE_EMPTY_A | mark);
+        } else {
+            unsigned a = TILE_EMPTY_A;
+            long dist = map_distance[y][x];
+            if (dist != -1) {
+                c = dist % 10 + '0';
+                a = RLHK_TUI_FR | RLHK_TUI_FG | RLHK_TUI_FB;
             }
+            rlhk_tui_putc(x, y, c, a | mark);
         }
     }
 }
 
-static int draw_dijkstra;
-
 static void
-map_draw(int px, int py)
+map_draw(void)
 {
     int x, y;
     for (y = 0; y < height; y++)
-        for (x = 0; x < width; x++) {
-            unsigned visible = map_visible[y][x] ? RLHK_TUI_FH : 0;
-            if (ON_BORDER(x, y))
-                rlhk_tui_putc(x, y, TILE_WALL_C, TILE_WALL_A | visible);
-            else if (game_map[0][y][x])
-                rlhk_tui_putc(x, y, TILE_DIRT_C, TILE_DIRT_A | visible);
-            else {
-                unsigned mark = map_marked[y][x] ? RLHK_TUI_BR : 0;
-                unsigned c = visible ? TILE_EMPTY_C : ' ';
-                mark |= visible;
-                if (!draw_dijkstra) {
-                    rlhk_tui_putc(x, y, c, TILE_EMPTY_A | mark);
-                } else {
-                    unsigned a = TILE_EMPTY_A;
-                    long dist = map_distance[y][x];
-                    if (dist != -1) {
-                        c = dist % 10 + '0';
-                        a = RLHK_TUI_FR | RLHK_TUI_FG | RLHK_TUI_FB;
-                    }
-                    rlhk_tui_putc(x, y, c, a | mark);
-                }
-            }
-        }
-    rlhk_tui_putc(px, py, TILE_PLAYER_C, TILE_PLAYER_A);
-    if (!rlhk_tui_flush())
-        abort();
+        for (x = 0; x < width; x++)
+            tile_draw(x, y);
+}
+
+/* Apply a view change, redrawing only the tiles that changed. */
+static void
+view_update(const struct rlhk_algo_fov_delta *delta)
+{
+    long i;
+    for (i = 0; i < delta->nentered; i++) {
+        int x = delta->entered[i * 2 + 0];
+        int y = delta->entered[i * 2 + 1];
+        map_visible[y][x] = 1;
+        tile_draw(x, y);
+    }
+    for (i = 0; i < delta->nleft; i++) {
+        int x = delta->left[i * 2 + 0];
+        int y = delta->left[i * 2 + 1];
+        map_visible[y][x] = 0;
+        tile_draw(x, y);
+    }
 }
 
 RLHK_ALGO_API
@@ -125,7 +145,7 @@ rlhk_algo_map_call(rlhk_algo_map map,
         abort();
     switch (method) {
         case RLHK_ALGO_MAP_GET_PASSABLE:
-            return game_map[0][y][x] == 0;
+            return game_map[y][x] == 0;
         case RLHK_ALGO_MAP_CLEAR_DISTANCE:
             p = &map_distance[0][0];
             for (i = 0; i < sizeof(map_distance) / sizeof(long); i++)
@@ -146,7 +166,9 @@ rlhk_algo_map_call(rlhk_algo_map map,
             return map_route[y][x];
         case RLHK_ALGO_MAP_MARK_VISIBLE:
             map_visible[y][x] = 1;
-            return game_map[0][y][x] == 0;
+            return game_map[y][x] == 0;
+        case RLHK_ALGO_MAP_GET_TRANSPARENT:
+            return game_map[y][x] == 0;
     }
     abort();
 }
@@ -162,9 +184,18 @@ find_path(int x0, int y0, int x1, int y1)
 int
 main(void)
 {
+    static long fov_buf[RLHK_ALGO_FOV_CACHE_BUFLEN(FOV_CACHE_SIZE,
+                                                   FOV_MAX_RADIUS) /
+                        sizeof(long) + 1];
+    static char delta_buf[RLHK_ALGO_FOV_DELTA_BUFLEN(FOV_MAX_RADIUS)];
+    static short entered[FOV_DELTA_MAX * 2];
+    static short left[FOV_DELTA_MAX * 2];
+    struct rlhk_algo_fov_cache fov_cache[1];
+    struct rlhk_algo_fov_delta fov_delta[1];
     int x, y;
     int running = 1;
-    
+    int redraw = 1;
+
     if (!rlhk_tui_size(&width, &height))
         abort();
     if (width > RLHK_TUI_MAX_WIDTH)
@@ -177,6 +208,13 @@ main(void)
     if (!rlhk_tui_init(width, height))
         abort();
     map_generate();
+    if (!rlhk_algo_fov_cache_init(fov_cache, FOV_CACHE_SIZE, FOV_MAX_RADIUS,
+                                  fov_buf, sizeof(fov_buf)))
+        abort();
+    if (!rlhk_algo_fov_delta_init(fov_delta, FOV_MAX_RADIUS,
+                                  delta_buf, sizeof(delta_buf),
+                                  entered, left, FOV_DELTA_MAX))
+        abort();
 
     do {
         int k;
@@ -186,12 +224,27 @@ main(void)
         {
             short buf[256];
             long i = rlhk_algo_buf_push(buf, sizeof(buf), 0, x, y);
+            const unsigned char *set;
             rlhk_algo_dijkstra(0, buf, sizeof(buf), i);
-            memset(map_visible, 0, sizeof(map_visible));
-            rlhk_algo_fov(0, x, y, fov_radius);
+            /* The map never changes, so its version is always 0. */
+            set = rlhk_algo_fov_cached(fov_cache, 0, x, y, fov_radius, 0);
+            if (!rlhk_algo_fov_delta(fov_delta, 0, set, x, y, fov_radius))
+                abort();
+            if (redraw || draw_dijkstra ||
+                fov_delta->nentered > fov_delta->max ||
+                fov_delta->nleft > fov_delta->max) {
+                memset(map_visible, 0, sizeof(map_visible));
+                rlhk_algo_fov_replay(0, set, x, y, fov_radius);
+                map_draw();
+                redraw = 0;
+            } else {
+                view_update(fov_delta);
+            }
         }
 
-        map_draw(x, y);
+        rlhk_tui_putc(x, y, TILE_PLAYER_C, TILE_PLAYER_A);
+        if (!rlhk_tui_flush())
+            abort();
         if ((k = rlhk_tui_getch()) == -1)
             abort();
         switch (k) {
@@ -229,22 +282,27 @@ main(void)
                 break;
             case ' ':
                 find_path(x, y, width / 2, height / 2);
+                redraw = 1;
                 break;
             case '+':
-                fov_radius++;
+                if (fov_radius < FOV_MAX_RADIUS)
+                    fov_radius++;
                 break;
             case '-':
-                fov_radius--;
+                if (fov_radius > 0)
+                    fov_radius--;
                 break;
             case 'x':
                 draw_dijkstra  = !draw_dijkstra;
+                redraw = 1;
                 break;
             case RLHK_TUI_VK_SIGINT:
             case 'q':
                 running = 0;
                 break;
         }
-        if (!game_map[0][y + dy][x + dx]) {
+        if (!game_map[y + dy][x + dx]) {
+            tile_draw(x, y); /* erase the player */
             x += dx;
             y += dy;
         }
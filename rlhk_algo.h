@@ -19,9 +19,51 @@
  * want to use "long" (possibly 64 bits) in your map representation
  * and instead try to specifically use a 32-bit integer.
  *
+ * For worlds larger than 16-bit coordinates allow, see rlhk_chunk.h,
+ * which lets these functions run relative to an origin chunk.
+ *
+ * Define RLHK_ALGO_STATS before including the implementation to count
+ * map calls (per method), queue pushes and pops, and expanded nodes
+ * into the struct returned by rlhk_algo_stats(). The counters are one
+ * global struct, so a stats build must only run these functions on
+ * one thread at a time, unless you also define RLHK_ALGO_STATS_STORAGE
+ * to give each thread its own, e.g. "static __thread".
+ *
+ * You may also define RLHK_ALGO_TRACE(func, phase) to hook the start
+ * of each phase of each function, e.g. RLHK_ALGO_TRACE(shortest,
+ * search). Both the counters and the hook compile to nothing by
+ * default.
+ *
+ * The functions above keep all per-query state in your map, so they
+ * are not re-entrant. The "_r" functions instead keep distances,
+ * gradients and their queue in a caller-owned context, and only ask
+ * the map whether tiles are passable. Any number of threads may query
+ * one shared map at once, each with its own context, so long as your
+ * RLHK_ALGO_MAP_GET_PASSABLE is itself safe to call concurrently.
+ *
  * Functions:
  *   - rlhk_algo_shortest
  *   - rlhk_algo_dijkstra
+ *   - rlhk_algo_fov
+ *   - rlhk_algo_fov_set
+ *   - rlhk_algo_fov_replay
+ *   - rlhk_algo_fov_cache_init
+ *   - rlhk_algo_fov_cached
+ *   - rlhk_algo_fov_delta_init
+ *   - rlhk_algo_fov_delta
+ *   - rlhk_algo_ctx_init
+ *   - rlhk_algo_shortest_r
+ *   - rlhk_algo_dijkstra_r
+ *   - rlhk_algo_ctx_distance
+ *   - rlhk_algo_ctx_gradient
+ *   - rlhk_algo_ctx_route
+ *   - rlhk_algo_batch_plan
+ *   - rlhk_algo_shortest_batch
+ *   - rlhk_algo_dijkstra_many
+ *   - rlhk_algo_diffuse_init
+ *   - rlhk_algo_diffuse_add
+ *   - rlhk_algo_diffuse_get
+ *   - rlhk_algo_diffuse_step
  */
 #ifndef RLHK_ALGO_H
 #define RLHK_ALGO_H
@@ -34,6 +76,15 @@
 #  endif
 #endif
 
+#include <limits.h>
+
+/* Smallest integer type holding 32-bit path lengths. */
+#if INT_MAX >= 2147483647
+typedef int rlhk_algo_i32;
+#else
+typedef long rlhk_algo_i32;
+#endif
+
 #define RLHK_ALGO_DX(i) ((int)((0x0489a621UL >> (4 * (i) + 0)) & 3) - 1)
 #define RLHK_ALGO_DY(i) ((int)((0x0489a621UL >> (4 * (i) + 2)) & 3) - 1)
 
@@ -106,9 +157,20 @@ enum rlhk_algo_map_method {
      *
      * The "data" parameter is unused.
      */
-    RLHK_ALGO_MAP_MARK_VISIBLE
+    RLHK_ALGO_MAP_MARK_VISIBLE,
+
+    /**
+     * Asks if the tile at (x, y) is transparent: non-zero for true, 0
+     * for false. Unlike RLHK_ALGO_MAP_MARK_VISIBLE, nothing should be
+     * marked.
+     *
+     * The "data" parameter is unused.
+     */
+    RLHK_ALGO_MAP_GET_TRANSPARENT
 };
 
+#define RLHK_ALGO_MAP_NMETHODS (RLHK_ALGO_MAP_GET_TRANSPARENT + 1)
+
 /**
  * Generic map interface provided to RLHK.
  *
@@ -208,13 +270,524 @@ int rlhk_algo_dijkstra(rlhk_algo_map map, short *buf, long buflen, long i);
 RLHK_ALGO_API
 void rlhk_algo_fov(rlhk_algo_map map, int x, int y, int radius);
 
+/**
+ * Side length of the square covered by a visibility set: tiles within
+ * radius + 1 of the center, since a ray may stop one tile past the
+ * radius.
+ */
+#define RLHK_ALGO_FOV_SIDE(radius) (2 * (radius) + 3)
+
+/**
+ * Size in bytes of a visibility set for the given radius.
+ */
+#define RLHK_ALGO_FOV_SETLEN(radius) \
+    ((RLHK_ALGO_FOV_SIDE(radius) * RLHK_ALGO_FOV_SIDE(radius) + 7) / 8)
+
+/**
+ * Returns non-zero if the tile at offset (dx, dy) from the center is
+ * in the visibility set. Both offsets must be within radius + 1.
+ */
+#define RLHK_ALGO_FOV_GET(set, radius, dx, dy) \
+    (((set)[RLHK_ALGO_FOV_BIT(radius, dx, dy) / 8] >> \
+      (RLHK_ALGO_FOV_BIT(radius, dx, dy) % 8)) & 1)
+#define RLHK_ALGO_FOV_BIT(radius, dx, dy) \
+    (((long)(dy) + (radius) + 1) * RLHK_ALGO_FOV_SIDE(radius) + \
+     (dx) + (radius) + 1)
+
+/**
+ * Compute the field-of-view from a given tile into a visibility set
+ * rather than marking it on the map.
+ *
+ * The set (set) is a bitmap of the RLHK_ALGO_FOV_SIDE(radius) square
+ * centered on (x, y), RLHK_ALGO_FOV_SETLEN(radius) bytes long, read
+ * back with RLHK_ALGO_FOV_GET(). It need not be initialized. The
+ * tiles are exactly those rlhk_algo_fov() would mark, so sets may be
+ * kept, compared and replayed later.
+ *
+ * Methods used:
+ *   RLHK_ALGO_MAP_GET_TRANSPARENT
+ */
+RLHK_ALGO_API
+void rlhk_algo_fov_set(rlhk_algo_map map, int x, int y, int radius,
+                       unsigned char *set);
+
+/**
+ * Mark every tile of a visibility set computed at (x, y) with the
+ * given radius, as rlhk_algo_fov() would have. Since a set holds
+ * every tile exactly once, this is much cheaper than raycasting.
+ *
+ * Methods used:
+ *   RLHK_ALGO_MAP_MARK_VISIBLE
+ */
+RLHK_ALGO_API
+void rlhk_algo_fov_replay(rlhk_algo_map map, const unsigned char *set,
+                          int x, int y, int radius);
+
+/**
+ * A small cache of recent visibility sets, keyed by viewer position,
+ * radius and map version. Treat the fields as private.
+ */
+struct rlhk_algo_fov_entry {
+    int x;
+    int y;
+    int radius;
+    unsigned long version;
+    unsigned long used;
+};
+
+struct rlhk_algo_fov_cache {
+    struct rlhk_algo_fov_entry *entries;
+    unsigned char *sets;
+    int n;
+    int maxradius;
+    unsigned long clock;
+};
+
+/**
+ * Always-sufficient buffer size, in bytes, for a cache of n sets of
+ * up to the given radius.
+ */
+#define RLHK_ALGO_FOV_CACHE_BUFLEN(n, maxradius) \
+    ((long)((n) * (sizeof(struct rlhk_algo_fov_entry) + \
+                   RLHK_ALGO_FOV_SETLEN(maxradius))))
+
+/**
+ * Prepare an empty cache of n visibility sets for radii of at most
+ * maxradius.
+ *
+ * You must provide the cache's memory (buf) and its size in bytes
+ * (buflen), suitably aligned for a long. It need not be initialized.
+ *
+ * Returns 1 on success or 0 if the buffer is too small.
+ */
+RLHK_ALGO_API
+int rlhk_algo_fov_cache_init(struct rlhk_algo_fov_cache *cache, int n,
+                             int maxradius, void *buf, long buflen);
+
+/**
+ * Returns the visibility set for a viewer at (x, y) with the given
+ * radius, computing it with rlhk_algo_fov_set() only if it isn't
+ * already cached, in which case the least recently used set is
+ * replaced.
+ *
+ * The version is any number you change whenever the transparency of
+ * any tile changes, such as a counter, so stale sets are never used.
+ * The returned set remains valid until the next call. Returns null if
+ * the radius is out of range.
+ *
+ * Methods used:
+ *   RLHK_ALGO_MAP_GET_TRANSPARENT
+ */
+RLHK_ALGO_API
+const unsigned char *rlhk_algo_fov_cached(struct rlhk_algo_fov_cache *cache,
+                                          rlhk_algo_map map, int x, int y,
+                                          int radius, unsigned long version);
+
+/**
+ * Tracks which tiles entered and left view between successive fields
+ * of view, so that callers only need to redraw (or wake monsters on)
+ * the tiles that changed.
+ *
+ * After each rlhk_algo_fov_delta(), the entered and left lists hold
+ * nentered and nleft tiles as pairs of shorts. When a count exceeds
+ * the lists' capacity (max), only the first max tiles are stored, and
+ * you should fall back to handling the whole view. Treat the other
+ * fields as private.
+ */
+struct rlhk_algo_fov_delta {
+    short *entered;
+    short *left;
+    long nentered;
+    long nleft;
+    long max;
+    unsigned char *set[2];
+    int x;
+    int y;
+    int radius;
+    int maxradius;
+    int valid;
+};
+
+/**
+ * Always-sufficient buffer size, in bytes, for a delta tracker with
+ * radii of at most maxradius.
+ */
+#define RLHK_ALGO_FOV_DELTA_BUFLEN(maxradius) \
+    (2L * RLHK_ALGO_FOV_SETLEN(maxradius))
+
+/**
+ * Prepare a delta tracker with nothing yet in view, for radii of at
+ * most maxradius.
+ *
+ * You must provide the memory for its pair of visibility sets (buf)
+ * and its size in bytes (buflen), which need not be initialized, and
+ * the entered and left lists, each with room for max pairs of shorts.
+ *
+ * Returns 1 on success or 0 if the buffer is too small.
+ */
+RLHK_ALGO_API
+int rlhk_algo_fov_delta_init(struct rlhk_algo_fov_delta *delta,
+                             int maxradius, void *buf, long buflen,
+                             short *entered, short *left, long max);
+
+/**
+ * Move the view to a viewer at (x, y) with the given radius and list
+ * the tiles that entered and left view since the previous call.
+ *
+ * Pass the new visibility set (set), such as from
+ * rlhk_algo_fov_cached(), or null to have it computed with
+ * rlhk_algo_fov_set(). The set is copied, so it needn't outlive the
+ * call. The work done is proportional to the size of the view, not
+ * the map.
+ *
+ * Returns 1 on success or 0 if the radius is out of range.
+ *
+ * Methods used:
+ *   RLHK_ALGO_MAP_GET_TRANSPARENT (only when set is null)
+ */
+RLHK_ALGO_API
+int rlhk_algo_fov_delta(struct rlhk_algo_fov_delta *delta,
+                        rlhk_algo_map map, const unsigned char *set,
+                        int x, int y, int radius);
+
+/**
+ * Per-query state for the re-entrant "_r" functions.
+ *
+ * A context covers a window of the map: the tiles from (x, y) to
+ * (x + width - 1, y + height - 1). Searches never leave the window.
+ * Treat the fields as private.
+ */
+struct rlhk_algo_ctx {
+    int x;
+    int y;
+    int width;
+    int height;
+    rlhk_algo_i32 *distance;
+    rlhk_algo_i32 *queue;
+    unsigned short *stamp;
+    unsigned char *gradient;
+    long queuelen;
+    unsigned epoch;
+};
+
+/**
+ * Always-sufficient context buffer size, in bytes, for a window of
+ * width by height tiles.
+ */
+#define RLHK_ALGO_CTX_BUFLEN(width, height) \
+    ((long)(width) * (height) * \
+     (sizeof(rlhk_algo_i32) * 5 + sizeof(unsigned short) + 1) + \
+     sizeof(rlhk_algo_i32))
+
+/**
+ * Prepare a context for the window with top-left tile (x, y).
+ *
+ * You must provide the context's memory (buf) and its size in bytes
+ * (buflen), suitably aligned for an int (e.g. from malloc()). The
+ * memory need not be initialized. RLHK_ALGO_CTX_BUFLEN() is always
+ * sufficient. A smaller buffer shortens the search queue, which
+ * allows searches to (safely) run out of memory as an early bailout.
+ *
+ * Returns 1 on success or 0 if the buffer is too small.
+ */
+RLHK_ALGO_API
+int rlhk_algo_ctx_init(struct rlhk_algo_ctx *ctx, int x, int y,
+                       int width, int height, void *buf, long buflen);
+
+/**
+ * Re-entrant rlhk_algo_shortest().
+ *
+ * Rather than marking the route on the map, the route is left in the
+ * context. Use rlhk_algo_ctx_route() starting at (x1, y1) to extract
+ * it. Search from your goal to your agent if you'd like the route in
+ * walking order.
+ *
+ * Returns the length of the path, -1 if no path could be found, or -2
+ * if it ran out of queue memory.
+ *
+ * Methods used:
+ *   RLHK_ALGO_MAP_GET_PASSABLE
+ */
+RLHK_ALGO_API
+long rlhk_algo_shortest_r(struct rlhk_algo_ctx *ctx, rlhk_algo_map map,
+                          int x0, int y0, int x1, int y1);
+
+/**
+ * Re-entrant rlhk_algo_dijkstra().
+ *
+ * The n points of interest are pairs of shorts in seeds, as filled by
+ * rlhk_algo_buf_push(), and are left untouched. Results are read back
+ * with rlhk_algo_ctx_distance() and rlhk_algo_ctx_gradient().
+ *
+ * Returns 1 on success or 0 if it ran out of queue memory.
+ *
+ * Methods used:
+ *   RLHK_ALGO_MAP_GET_PASSABLE
+ */
+RLHK_ALGO_API
+int rlhk_algo_dijkstra_r(struct rlhk_algo_ctx *ctx, rlhk_algo_map map,
+                         const short *seeds, long n);
+
+/**
+ * Returns the distance computed by the last query on this context,
+ * or -1 if the tile was not reached.
+ */
+RLHK_ALGO_API
+long rlhk_algo_ctx_distance(const struct rlhk_algo_ctx *ctx, int x, int y);
+
+/**
+ * Returns the direction (0-7) one step closer to the source of the
+ * last query on this context, or -1 for sources and unreached tiles.
+ */
+RLHK_ALGO_API
+int rlhk_algo_ctx_gradient(const struct rlhk_algo_ctx *ctx, int x, int y);
+
+/**
+ * Follow the gradient from (x, y) down to the source of the last
+ * query, storing up to max coordinates in route as pairs of shorts,
+ * starting with (x, y) itself and ending at the source.
+ *
+ * Returns the number of tiles in the full route, which may exceed
+ * max, or 0 if (x, y) was not reached.
+ */
+RLHK_ALGO_API
+long rlhk_algo_ctx_route(const struct rlhk_algo_ctx *ctx, int x, int y,
+                         short *route, long max);
+
+/**
+ * One path request for rlhk_algo_shortest_batch().
+ *
+ * Fill in the agent (x0, y0), its goal (x1, y1), and a route buffer
+ * with room for max pairs of shorts. The other fields are outputs.
+ */
+struct rlhk_algo_query {
+    short x0;
+    short y0;
+    short x1;
+    short y1;
+    short *route;
+    long max;
+    long length;
+};
+
+/**
+ * Group a batch of queries by goal for rlhk_algo_shortest_batch().
+ *
+ * Fills order with the n query indices such that queries sharing a
+ * goal are adjacent. This must run once, on one thread, before any
+ * worker starts on the batch.
+ *
+ * Returns the number of distinct goals.
+ */
+RLHK_ALGO_API
+long rlhk_algo_batch_plan(const struct rlhk_algo_query *queries, long n,
+                          long *order);
+
+/**
+ * Answer this worker's share of a planned batch of path queries.
+ *
+ * Worker w of nworkers answers a contiguous run of goal groups
+ * covering about n / nworkers queries: every group whose first query
+ * lies in positions [n * w / nworkers, n * (w + 1) / nworkers) of
+ * order. Several threads may each call this on the same batch, with
+ * their own contexts and worker numbers, while sharing the map and
+ * queries.
+ * Goals shared by several agents cost a single flood outward from
+ * the goal, which stops once every such agent is reached; lone goals
+ * use A*. For dynamic load balancing, pick nworkers much larger than
+ * your thread count and have threads claim worker numbers from a
+ * shared counter.
+ *
+ * Each query gets its route from the agent to the goal, inclusive,
+ * with length set to the number of steps. When the route exceeds
+ * max tiles only the first max are stored. The length is -1 if there
+ * is no path and -2 if the context ran out of queue memory.
+ *
+ * Though floods run backwards from the goal, RLHK_ALGO_MAP_GET_PASSABLE
+ * is asked about the same moves as rlhk_algo_shortest_r() from the
+ * agent: whether the agent may enter (x, y) from the neighbor in
+ * direction data. It's never asked about an agent's own tile, so an
+ * occupancy test (e.g. RLHK_SPACE_OCCUPIED) doesn't strand agents.
+ *
+ * Methods used:
+ *   RLHK_ALGO_MAP_GET_PASSABLE
+ */
+RLHK_ALGO_API
+void rlhk_algo_shortest_batch(struct rlhk_algo_ctx *ctx, rlhk_algo_map map,
+                              struct rlhk_algo_query *queries,
+                              const long *order, long n,
+                              int worker, int nworkers);
+
+/**
+ * One distance field for rlhk_algo_dijkstra_many().
+ *
+ * The n seeds are pairs of shorts, as filled by rlhk_algo_buf_push().
+ * The distance grid holds width * height values in row-major order,
+ * and is filled with -1 for unreached tiles.
+ */
+struct rlhk_algo_field {
+    const short *seeds;
+    long nseeds;
+    rlhk_algo_i32 *distance;
+};
+
+/**
+ * Always-sufficient scratch buffer size, in bytes, for
+ * rlhk_algo_dijkstra_many() over a width by height map.
+ */
+#define RLHK_ALGO_MANY_BUFLEN(width, height) \
+    ((long)((height) * \
+     (((width) + CHAR_BIT * sizeof(unsigned long) - 1) / \
+      (CHAR_BIT * sizeof(unsigned long)) * 3 * sizeof(unsigned long) + \
+      6 * sizeof(int))))
+
+/**
+ * Compute several rlhk_algo_dijkstra() distance fields over one wall
+ * bitboard, without calling into your map at all.
+ *
+ * The walls use the rlhk_gen.h bitboard layout: rows of unsigned long
+ * words, one bit per tile, least significant bit first, with a set
+ * bit for each impassable tile. The flood advances a whole frontier
+ * word at a time in all 8 directions, so per-direction passability
+ * rules are not supported. Tiles outside the map are impassable.
+ *
+ * Fields are dealt out round-robin: worker w of nworkers computes
+ * every field whose index modulo nworkers is w. Any number of
+ * threads may share the walls and fields, each with its own worker
+ * number and scratch buffer (buf), which need not be initialized.
+ * RLHK_ALGO_MANY_BUFLEN() gives its size in bytes (buflen).
+ *
+ * Returns 1 on success or 0 if the buffer is too small.
+ */
+RLHK_ALGO_API
+int rlhk_algo_dijkstra_many(const unsigned long *walls, int width,
+                            int height, struct rlhk_algo_field *fields,
+                            int nfields, void *buf, long buflen,
+                            int worker, int nworkers);
+
+/**
+ * A scalar field, such as noise or scent, spreading over the map.
+ *
+ * Values live in a grid padded with a one-tile border of zeros: tile
+ * (x, y) is grid[(y + 1) * stride + x + 1]. Only the dirty rectangle
+ * from (x0, y0) to (x1, y1), inclusive, may be non-zero, and it is
+ * empty when x0 > x1. Treat the fields as read-only.
+ */
+struct rlhk_algo_diffuse {
+    float *grid;
+    float *scratch;
+    int width;
+    int height;
+    int stride;
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+/**
+ * Always-sufficient diffusion buffer size, in bytes, for a width by
+ * height map.
+ */
+#define RLHK_ALGO_DIFFUSE_BUFLEN(width, height) \
+    ((long)(((width) + 2) * ((height) + 2) * 2 * sizeof(float)))
+
+/**
+ * Prepare an all-zero field over a width by height map.
+ *
+ * You must provide the field's memory (buf) and its size in bytes
+ * (buflen), suitably aligned for a float. It need not be initialized.
+ *
+ * Returns 1 on success or 0 if the buffer is too small.
+ */
+RLHK_ALGO_API
+int rlhk_algo_diffuse_init(struct rlhk_algo_diffuse *d, int width,
+                           int height, void *buf, long buflen);
+
+/**
+ * Add an amount to the field at (x, y), e.g. a noise or a scent mark.
+ * Tiles outside the map are ignored.
+ */
+RLHK_ALGO_API
+void rlhk_algo_diffuse_add(struct rlhk_algo_diffuse *d, int x, int y,
+                           float amount);
+
+/**
+ * Returns the field's value at (x, y), or 0 outside the map.
+ */
+RLHK_ALGO_API
+float rlhk_algo_diffuse_get(const struct rlhk_algo_diffuse *d, int x, int y);
+
+/**
+ * Spread the field one step.
+ *
+ * Each tile moves toward the average of its 4 neighbours by the given
+ * rate (0 to 1), and is then multiplied by its entry in keep, a
+ * row-major width by height array: 1 for open floor, a little less
+ * for absorbent floor, and 0 for walls, which then never hold a
+ * value. Values that fall below cutoff are flushed to zero, so the
+ * dirty rectangle shrinks again as the field fades. Only the dirty
+ * rectangle and a one-tile margin around it are visited.
+ */
+RLHK_ALGO_API
+void rlhk_algo_diffuse_step(struct rlhk_algo_diffuse *d, const float *keep,
+                            float rate, float cutoff);
+
+#ifdef RLHK_ALGO_STATS
+/**
+ * Work counters accumulated by every function in this header.
+ *
+ * Zero the struct before a call and read it afterwards to measure
+ * that one call. Nodes expanded are A* nodes popped from the open
+ * set, Dijkstra tiles dequeued, or FOV rays cast.
+ */
+struct rlhk_algo_stats {
+    unsigned long calls[RLHK_ALGO_MAP_NMETHODS];
+    unsigned long pushes;
+    unsigned long pops;
+    unsigned long expanded;
+};
+
+/**
+ * Returns the counters of a RLHK_ALGO_STATS build. These are shared
+ * by all threads unless RLHK_ALGO_STATS_STORAGE is thread-local, in
+ * which case they're the calling thread's.
+ */
+RLHK_ALGO_API
+struct rlhk_algo_stats *rlhk_algo_stats(void);
+#endif
+
 /* Implementation */
 #if defined(RLHK_IMPLEMENTATION) || defined(RLHK_ALGO_IMPLEMENTATION)
 #include <stdlib.h>
-#include <limits.h>
+#include <string.h>
 
-#define RLHK_ALGO_CALL(m, method, x, y, d) \
+#ifdef RLHK_ALGO_STATS
+#ifndef RLHK_ALGO_STATS_STORAGE
+#  define RLHK_ALGO_STATS_STORAGE static
+#endif
+RLHK_ALGO_STATS_STORAGE struct rlhk_algo_stats rlhk_algo_stats_data;
+
+RLHK_ALGO_API
+struct rlhk_algo_stats *
+rlhk_algo_stats(void)
+{
+    return &rlhk_algo_stats_data;
+}
+
+#  define RLHK_ALGO_COUNT(field) (rlhk_algo_stats_data.field++)
+#  define RLHK_ALGO_CALL(m, method, x, y, d) \
+    (rlhk_algo_stats_data.calls[RLHK_ALGO_MAP_##method]++, \
+     rlhk_algo_map_call((m), RLHK_ALGO_MAP_##method, (x), (y), (d)))
+#else
+#  define RLHK_ALGO_COUNT(field) ((void)0)
+#  define RLHK_ALGO_CALL(m, method, x, y, d) \
     rlhk_algo_map_call((m), RLHK_ALGO_MAP_##method, (x), (y), (d))
+#endif
+
+#ifndef RLHK_ALGO_TRACE
+#  define RLHK_ALGO_TRACE(func, phase)
+#endif
 
 struct rlhk_algo_heap {
     short *coords;
@@ -241,6 +814,7 @@ rlhk_algo_heap_push(struct rlhk_algo_heap *heap,
     if (heap->count == heap->size)
         return 0;
 
+    RLHK_ALGO_COUNT(pushes);
     n = heap->count++;
     heap->coords[n * 2 + 0] = x;
     heap->coords[n * 2 + 1] = y;
@@ -268,6 +842,7 @@ rlhk_algo_heap_pop(struct rlhk_algo_heap *heap, rlhk_algo_map map)
     int x = heap->coords[0] = heap->coords[d * 2 + 0];
     int y = heap->coords[1] = heap->coords[d * 2 + 1];
     long f = RLHK_ALGO_CALL(map, GET_HEURISTIC, x, y, 0);
+    RLHK_ALGO_COUNT(pops);
     while (n < heap->count) {
         long an, af, bn, bf;
         an = 2 * n + 1;
@@ -313,12 +888,14 @@ rlhk_algo_shortest(rlhk_algo_map m, int x0, int y0, int x1, int y1,
     heap->count = 0;
     heap->size = buflen / (sizeof(heap->coords[0]) * 2);
 
+    RLHK_ALGO_TRACE(shortest, begin);
     RLHK_ALGO_CALL(m, CLEAR_DISTANCE, 0, 0, 0);
     RLHK_ALGO_CALL(m, SET_DISTANCE, x0, y0, 0);
     RLHK_ALGO_CALL(m, SET_HEURISTIC, x0, y0, origin_heuristic);
     RLHK_ALGO_CALL(m, SET_GRADIENT, x0, y0, -1);
     rlhk_algo_heap_push(heap, m, x0, y0);
 
+    RLHK_ALGO_TRACE(shortest, search);
     while (heap->count) {
         int d;
         int x = heap->coords[0];
@@ -329,6 +906,7 @@ rlhk_algo_shortest(rlhk_algo_map m, int x0, int y0, int x1, int y1,
             break;
         }
         rlhk_algo_heap_pop(heap, m);
+        RLHK_ALGO_COUNT(expanded);
         g = RLHK_ALGO_CALL(m, GET_DISTANCE, x, y, 0);
         for (d = 0; d < 8; d++) {
             long tentative = g + 1;
@@ -344,13 +922,16 @@ rlhk_algo_shortest(rlhk_algo_map m, int x0, int y0, int x1, int y1,
                 RLHK_ALGO_CALL(m, SET_GRADIENT, tx, ty, (d + 4) % 8);
                 RLHK_ALGO_CALL(m, SET_DISTANCE, tx, ty, tentative);
                 RLHK_ALGO_CALL(m, SET_HEURISTIC, tx, ty, tentative + h);
-                if (!rlhk_algo_heap_push(heap, m, tx, ty))
+                if (!rlhk_algo_heap_push(heap, m, tx, ty)) {
+                    RLHK_ALGO_TRACE(shortest, end);
                     return -2; /* out of memory */
+                }
             }
         }
     }
 
     /* Reconstruct shortest route. */
+    RLHK_ALGO_TRACE(shortest, reconstruct);
     if (length == 0) {
         int x = x1;
         int y = y1;
@@ -364,6 +945,7 @@ rlhk_algo_shortest(rlhk_algo_map m, int x0, int y0, int x1, int y1,
         RLHK_ALGO_CALL(m, MARK_SHORTEST, x, y, length);
     }
 
+    RLHK_ALGO_TRACE(shortest, end);
     return length;
 }
 
@@ -389,6 +971,7 @@ int rlhk_algo_dijkstra(rlhk_algo_map m, short *buf, long buflen, long head)
     long i;
 
     /* Initialize distances. */
+    RLHK_ALGO_TRACE(dijkstra, begin);
     RLHK_ALGO_CALL(m, CLEAR_DISTANCE, 0, 0, 0);
     for (i = 0; i < head; i++) {
         int x = buf[i * 2 + 0];
@@ -397,12 +980,15 @@ int rlhk_algo_dijkstra(rlhk_algo_map m, short *buf, long buflen, long head)
     }
 
     /* Breadth-first search. */
+    RLHK_ALGO_TRACE(dijkstra, search);
     while (tail != head) {
         int d;
         int x = buf[tail * 2 + 0];
         int y = buf[tail * 2 + 1];
         long v = RLHK_ALGO_CALL(m, GET_DISTANCE, x, y, 0);
         tail = (tail + 1) % size;
+        RLHK_ALGO_COUNT(pops);
+        RLHK_ALGO_COUNT(expanded);
         for (d = 0; d < 8; d++) {
             int cx = x + RLHK_ALGO_DX(d);
             int cy = y + RLHK_ALGO_DY(d);
@@ -412,8 +998,11 @@ int rlhk_algo_dijkstra(rlhk_algo_map m, short *buf, long buflen, long head)
                 if (cv == -1) {
                     long next = (head + 1) % size;
                     RLHK_ALGO_CALL(m, SET_DISTANCE, cx, cy, v + 1);
-                    if (next == tail)
+                    if (next == tail) {
+                        RLHK_ALGO_TRACE(dijkstra, end);
                         return 0; /* out of memory */
+                    }
+                    RLHK_ALGO_COUNT(pushes);
                     buf[head * 2 + 0] = cx;
                     buf[head * 2 + 1] = cy;
                     head = next;
@@ -422,24 +1011,44 @@ int rlhk_algo_dijkstra(rlhk_algo_map m, short *buf, long buflen, long head)
             }
         }
     }
+    RLHK_ALGO_TRACE(dijkstra, end);
     return 1;
 }
 
+/* Visit one tile of a ray, either marking it on the map or adding it
+ * to a visibility set. Returns non-zero if the ray continues.
+ */
+static int
+rlhk_algo_see(rlhk_algo_map map, int x0, int y0, int x, int y, int r,
+              unsigned char *set)
+{
+    long b;
+    if (!set)
+        return RLHK_ALGO_CALL(map, MARK_VISIBLE, x, y, 0);
+    if (abs(x - x0) > r + 1 || abs(y - y0) > r + 1)
+        return 0;
+    b = RLHK_ALGO_FOV_BIT(r, x - x0, y - y0);
+    set[b / 8] |= 1 << (b % 8);
+    return RLHK_ALGO_CALL(map, GET_TRANSPARENT, x, y, 0);
+}
+
 static void
-rlhk_algo_raycast(rlhk_algo_map map, int x0, int y0, int x1, int y1, int r)
+rlhk_algo_raycast(rlhk_algo_map map, int x0, int y0, int x1, int y1, int r,
+                  unsigned char *set)
 {
     int dx = abs(x1 - x0);
     int dy = abs(y1 - y0);
     int sx = x1 < x0 ? -1 : 1;
     int sy = y1 < y0 ? -1 : 1;
     int r2 = r * r;
+    RLHK_ALGO_COUNT(expanded);
 
     if (dx > dy) {
         int d = 2 * dy - dx;
         int x, y = y0;
         for (x = x0; x != x1; x += sx) {
             int dist2 = (x - x0) * (x - x0) + (y - y0) * (y - y0);
-            if (!RLHK_ALGO_CALL(map, MARK_VISIBLE, x, y, 0) || dist2 > r2)
+            if (!rlhk_algo_see(map, x0, y0, x, y, r, set) || dist2 > r2)
                 return;
             if (d > 0) {
                 y += sy;
@@ -452,7 +1061,7 @@ rlhk_algo_raycast(rlhk_algo_map map, int x0, int y0, int x1, int y1, int r)
         int y, x = x0;
         for (y = y0; y != y1; y += sy) {
             int dist2 = (x - x0) * (x - x0) + (y - y0) * (y - y0);
-            if (!RLHK_ALGO_CALL(map, MARK_VISIBLE, x, y, 0) || dist2 > r2)
+            if (!rlhk_algo_see(map, x0, y0, x, y, r, set) || dist2 > r2)
                 return;
             if (d > 0) {
                 x += sx;
@@ -461,25 +1070,25 @@ rlhk_algo_raycast(rlhk_algo_map map, int x0, int y0, int x1, int y1, int r)
             d += 2 * dx;
         }
     }
-    RLHK_ALGO_CALL(map, MARK_VISIBLE, x1, y1, 0);
+    rlhk_algo_see(map, x0, y0, x1, y1, r, set);
 }
 
-RLHK_ALGO_API
-void
-rlhk_algo_fov(rlhk_algo_map map, int x0, int y0, int r)
+static void
+rlhk_algo_fov_rays(rlhk_algo_map map, int x0, int y0, int r,
+                   unsigned char *set)
 {
     int x = r + 16;
     int y = 0;
     int e = 0;
     while (x >= y) {
-        rlhk_algo_raycast(map, x0, y0, x0 + x, y0 + y, r);
-        rlhk_algo_raycast(map, x0, y0, x0 + y, y0 + x, r);
-        rlhk_algo_raycast(map, x0, y0, x0 - y, y0 + x, r);
-        rlhk_algo_raycast(map, x0, y0, x0 - x, y0 + y, r);
-        rlhk_algo_raycast(map, x0, y0, x0 - x, y0 - y, r);
-        rlhk_algo_raycast(map, x0, y0, x0 - y, y0 - x, r);
-        rlhk_algo_raycast(map, x0, y0, x0 + y, y0 - x, r);
-        rlhk_algo_raycast(map, x0, y0, x0 + x, y0 - y, r);
+        rlhk_algo_raycast(map, x0, y0, x0 + x, y0 + y, r, set);
+        rlhk_algo_raycast(map, x0, y0, x0 + y, y0 + x, r, set);
+        rlhk_algo_raycast(map, x0, y0, x0 - y, y0 + x, r, set);
+        rlhk_algo_raycast(map, x0, y0, x0 - x, y0 + y, r, set);
+        rlhk_algo_raycast(map, x0, y0, x0 - x, y0 - y, r, set);
+        rlhk_algo_raycast(map, x0, y0, x0 - y, y0 - x, r, set);
+        rlhk_algo_raycast(map, x0, y0, x0 + y, y0 - x, r, set);
+        rlhk_algo_raycast(map, x0, y0, x0 + x, y0 - y, r, set);
         if (e <= 0) {
             y++;
             e += 2 * y + 1;
@@ -491,5 +1100,1035 @@ rlhk_algo_fov(rlhk_algo_map map, int x0, int y0, int r)
     }
 }
 
+RLHK_ALGO_API
+void
+rlhk_algo_fov(rlhk_algo_map map, int x0, int y0, int r)
+{
+    RLHK_ALGO_TRACE(fov, begin);
+    rlhk_algo_fov_rays(map, x0, y0, r, 0);
+    RLHK_ALGO_TRACE(fov, end);
+}
+
+RLHK_ALGO_API
+void
+rlhk_algo_fov_set(rlhk_algo_map map, int x0, int y0, int r,
+                  unsigned char *set)
+{
+    RLHK_ALGO_TRACE(fov_set, begin);
+    memset(set, 0, RLHK_ALGO_FOV_SETLEN(r));
+    rlhk_algo_fov_rays(map, x0, y0, r, set);
+    RLHK_ALGO_TRACE(fov_set, end);
+}
+
+RLHK_ALGO_API
+void
+rlhk_algo_fov_replay(rlhk_algo_map map, const unsigned char *set,
+                     int x0, int y0, int r)
+{
+    long i, b;
+    long side = RLHK_ALGO_FOV_SIDE(r);
+    long len = RLHK_ALGO_FOV_SETLEN(r);
+    for (i = 0; i < len; i++) {
+        if (!set[i])
+            continue;
+        for (b = i * 8; b < i * 8 + 8; b++) {
+            if (set[i] >> (b % 8) & 1) {
+                int x = x0 + (int)(b % side) - r - 1;
+                int y = y0 + (int)(b / side) - r - 1;
+                RLHK_ALGO_CALL(map, MARK_VISIBLE, x, y, 0);
+            }
+        }
+    }
+}
+
+RLHK_ALGO_API
+int
+rlhk_algo_fov_cache_init(struct rlhk_algo_fov_cache *cache, int n,
+                         int maxradius, void *buf, long buflen)
+{
+    int i;
+    if (n < 1 || maxradius < 0 ||
+        buflen < RLHK_ALGO_FOV_CACHE_BUFLEN(n, maxradius))
+        return 0;
+    cache->entries = buf;
+    cache->sets = (unsigned char *)(cache->entries + n);
+    cache->n = n;
+    cache->maxradius = maxradius;
+    cache->clock = 0;
+    for (i = 0; i < n; i++) {
+        cache->entries[i].radius = -1;
+        cache->entries[i].used = 0;
+    }
+    return 1;
+}
+
+RLHK_ALGO_API
+const unsigned char *
+rlhk_algo_fov_cached(struct rlhk_algo_fov_cache *cache, rlhk_algo_map map,
+                     int x, int y, int radius, unsigned long version)
+{
+    int i;
+    int lru = 0;
+    long setlen = RLHK_ALGO_FOV_SETLEN(cache->maxradius);
+    struct rlhk_algo_fov_entry *e = cache->entries;
+
+    if (radius < 0 || radius > cache->maxradius)
+        return 0;
+    cache->clock++;
+    for (i = 0; i < cache->n; i++) {
+        if (e[i].radius == radius && e[i].x == x && e[i].y == y &&
+            e[i].version == version) {
+            e[i].used = cache->clock;
+            return cache->sets + setlen * i;
+        }
+        if (e[i].used < e[lru].used)
+            lru = i;
+    }
+
+    e[lru].x = x;
+    e[lru].y = y;
+    e[lru].radius = radius;
+    e[lru].version = version;
+    e[lru].used = cache->clock;
+    rlhk_algo_fov_set(map, x, y, radius, cache->sets + setlen * lru);
+    return cache->sets + setlen * lru;
+}
+
+RLHK_ALGO_API
+int
+rlhk_algo_fov_delta_init(struct rlhk_algo_fov_delta *delta, int maxradius,
+                         void *buf, long buflen,
+                         short *entered, short *left, long max)
+{
+    if (maxradius < 0 || buflen < RLHK_ALGO_FOV_DELTA_BUFLEN(maxradius))
+        return 0;
+    delta->entered = entered;
+    delta->left = left;
+    delta->nentered = 0;
+    delta->nleft = 0;
+    delta->max = max;
+    delta->set[0] = buf;
+    delta->set[1] = delta->set[0] + RLHK_ALGO_FOV_SETLEN(maxradius);
+    delta->maxradius = maxradius;
+    delta->valid = 0;
+    return 1;
+}
+
+/* Returns 1 if (x, y) is in the visibility set centered on (cx, cy). */
+static int
+rlhk_algo_fov_in(const unsigned char *set, int cx, int cy, int r,
+                 int x, int y)
+{
+    if (abs(x - cx) > r + 1 || abs(y - cy) > r + 1)
+        return 0;
+    return RLHK_ALGO_FOV_GET(set, r, x - cx, y - cy);
+}
+
+/* List the tiles of set a (centered on ax, ay) missing from set b. */
+static long
+rlhk_algo_fov_minus(const unsigned char *a, int ax, int ay, int ar,
+                    const unsigned char *b, int bx, int by, int br,
+                    short *list, long max)
+{
+    int dx, dy;
+    long n = 0;
+    for (dy = -ar - 1; dy <= ar + 1; dy++) {
+        for (dx = -ar - 1; dx <= ar + 1; dx++) {
+            int x = ax + dx;
+            int y = ay + dy;
+            if (!RLHK_ALGO_FOV_GET(a, ar, dx, dy) ||
+                rlhk_algo_fov_in(b, bx, by, br, x, y))
+                continue;
+            if (n < max) {
+                list[n * 2 + 0] = x;
+                list[n * 2 + 1] = y;
+            }
+            n++;
+        }
+    }
+    return n;
+}
+
+RLHK_ALGO_API
+int
+rlhk_algo_fov_delta(struct rlhk_algo_fov_delta *d, rlhk_algo_map map,
+                    const unsigned char *set, int x, int y, int r)
+{
+    unsigned char *old = d->set[0];
+    unsigned char *cur = d->set[1];
+
+    if (r < 0 || r > d->maxradius)
+        return 0;
+    RLHK_ALGO_TRACE(fov_delta, begin);
+    if (set)
+        memcpy(cur, set, RLHK_ALGO_FOV_SETLEN(r));
+    else
+        rlhk_algo_fov_set(map, x, y, r, cur);
+
+    /* Each list only needs a scan of one window, so a viewer jumping
+     * across the map costs no more than one taking a step.
+     */
+    RLHK_ALGO_TRACE(fov_delta, search);
+    if (d->valid) {
+        d->nentered = rlhk_algo_fov_minus(cur, x, y, r,
+                                          old, d->x, d->y, d->radius,
+                                          d->entered, d->max);
+        d->nleft = rlhk_algo_fov_minus(old, d->x, d->y, d->radius,
+                                       cur, x, y, r, d->left, d->max);
+    } else {
+        /* Nothing was in view: a radius of -2 has an empty window. */
+        d->nentered = rlhk_algo_fov_minus(cur, x, y, r, cur, x, y, -2,
+                                          d->entered, d->max);
+        d->nleft = 0;
+    }
+
+    /* Flip buffers: the new set becomes the old one. */
+    d->set[0] = cur;
+    d->set[1] = old;
+    d->x = x;
+    d->y = y;
+    d->radius = r;
+    d->valid = 1;
+    RLHK_ALGO_TRACE(fov_delta, end);
+    return 1;
+}
+
+RLHK_ALGO_API
+int
+rlhk_algo_ctx_init(struct rlhk_algo_ctx *ctx, int x, int y,
+                   int width, int height, void *buf, long buflen)
+{
+    long n = (long)width * height;
+    long fixed = n * (sizeof(rlhk_algo_i32) + sizeof(unsigned short) + 1);
+    long pad = sizeof(rlhk_algo_i32) - fixed % sizeof(rlhk_algo_i32);
+    char *p = buf;
+    if (width < 1 || height < 1 || buflen < fixed + pad)
+        return 0;
+    ctx->x = x;
+    ctx->y = y;
+    ctx->width = width;
+    ctx->height = height;
+    ctx->distance = (rlhk_algo_i32 *)p;
+    p += sizeof(rlhk_algo_i32) * n;
+    ctx->stamp = (unsigned short *)p;
+    p += sizeof(unsigned short) * n;
+    ctx->gradient = (unsigned char *)p;
+    p += n + pad;
+    ctx->queue = (rlhk_algo_i32 *)p;
+    ctx->queuelen = (buflen - fixed - pad) / sizeof(rlhk_algo_i32);
+    ctx->epoch = 0;
+    memset(ctx->stamp, 0, sizeof(unsigned short) * n);
+    return 1;
+}
+
+/* Invalidate all per-tile state in O(1). */
+static void
+rlhk_algo_ctx_begin(struct rlhk_algo_ctx *ctx)
+{
+    if (++ctx->epoch > USHRT_MAX) {
+        long n = (long)ctx->width * ctx->height;
+        memset(ctx->stamp, 0, sizeof(unsigned short) * n);
+        ctx->epoch = 1;
+    }
+}
+
+static long
+rlhk_algo_ctx_index(const struct rlhk_algo_ctx *ctx, int x, int y)
+{
+    int lx = x - ctx->x;
+    int ly = y - ctx->y;
+    if (lx < 0 || ly < 0 || lx >= ctx->width || ly >= ctx->height)
+        return -1;
+    return (long)ly * ctx->width + lx;
+}
+
+/* Index of (x, y) if the last query reached it, else -1. Epoch 0
+ * means no query has run yet, when every stamp still matches.
+ */
+static long
+rlhk_algo_ctx_reached(const struct rlhk_algo_ctx *ctx, int x, int y)
+{
+    long i = rlhk_algo_ctx_index(ctx, x, y);
+    if (i < 0 || !ctx->epoch || ctx->stamp[i] != ctx->epoch)
+        return -1;
+    return i;
+}
+
+/* Binary min-heap of (f, tile) pairs in the context queue. */
+static int
+rlhk_algo_ctx_push(struct rlhk_algo_ctx *ctx, long *count, long f, long i)
+{
+    rlhk_algo_i32 *h = ctx->queue;
+    long n = *count;
+    if ((n + 1) * 2 > ctx->queuelen)
+        return 0;
+    RLHK_ALGO_COUNT(pushes);
+    (*count)++;
+    while (n > 0) {
+        long p = (n - 1) / 2;
+        if (h[p * 2] <= f)
+            break;
+        h[n * 2 + 0] = h[p * 2 + 0];
+        h[n * 2 + 1] = h[p * 2 + 1];
+        n = p;
+    }
+    h[n * 2 + 0] = f;
+    h[n * 2 + 1] = i;
+    return 1;
+}
+
+static void
+rlhk_algo_ctx_pop(struct rlhk_algo_ctx *ctx, long *count)
+{
+    rlhk_algo_i32 *h = ctx->queue;
+    long c = --*count;
+    long f = h[c * 2 + 0];
+    long i = h[c * 2 + 1];
+    long n = 0;
+    RLHK_ALGO_COUNT(pops);
+    for (;;) {
+        long a = 2 * n + 1;
+        if (a >= c)
+            break;
+        if (a + 1 < c && h[(a + 1) * 2] < h[a * 2])
+            a++;
+        if (h[a * 2] >= f)
+            break;
+        h[n * 2 + 0] = h[a * 2 + 0];
+        h[n * 2 + 1] = h[a * 2 + 1];
+        n = a;
+    }
+    h[n * 2 + 0] = f;
+    h[n * 2 + 1] = i;
+}
+
+RLHK_ALGO_API
+long
+rlhk_algo_shortest_r(struct rlhk_algo_ctx *ctx, rlhk_algo_map m,
+                     int x0, int y0, int x1, int y1)
+{
+    long count = 0;
+    long goal = rlhk_algo_ctx_index(ctx, x1, y1);
+    long start = rlhk_algo_ctx_index(ctx, x0, y0);
+    unsigned short epoch;
+
+    if (start < 0 || goal < 0)
+        return -1;
+    RLHK_ALGO_TRACE(shortest_r, begin);
+    rlhk_algo_ctx_begin(ctx);
+    epoch = ctx->epoch;
+    ctx->distance[start] = 0;
+    ctx->stamp[start] = epoch;
+    ctx->gradient[start] = 8;
+    rlhk_algo_ctx_push(ctx, &count, RLHK_ALGO_MAX(abs(x0 - x1),
+                                                  abs(y0 - y1)), start);
+
+    RLHK_ALGO_TRACE(shortest_r, search);
+    while (count) {
+        int d;
+        long i = ctx->queue[1];
+        long f = ctx->queue[0];
+        int x = ctx->x + i % ctx->width;
+        int y = ctx->y + i / ctx->width;
+        long g = ctx->distance[i];
+        if (i == goal) {
+            RLHK_ALGO_TRACE(shortest_r, end);
+            return g;
+        }
+        rlhk_algo_ctx_pop(ctx, &count);
+        if (f > g + RLHK_ALGO_MAX(abs(x - x1), abs(y - y1)))
+            continue; /* stale entry, already improved */
+        RLHK_ALGO_COUNT(expanded);
+        for (d = 0; d < 8; d++) {
+            int tx = x + RLHK_ALGO_DX(d);
+            int ty = y + RLHK_ALGO_DY(d);
+            long t = rlhk_algo_ctx_index(ctx, tx, ty);
+            if (t < 0)
+                continue;
+            if (ctx->stamp[t] == epoch && ctx->distance[t] <= g + 1)
+                continue;
+            if (!RLHK_ALGO_CALL(m, GET_PASSABLE, tx, ty, (d + 4) % 8))
+                continue;
+            ctx->distance[t] = g + 1;
+            ctx->stamp[t] = epoch;
+            ctx->gradient[t] = (d + 4) % 8;
+            if (!rlhk_algo_ctx_push(ctx, &count, g + 1 +
+                    RLHK_ALGO_MAX(abs(tx - x1), abs(ty - y1)), t)) {
+                RLHK_ALGO_TRACE(shortest_r, end);
+                return -2; /* out of memory */
+            }
+        }
+    }
+    RLHK_ALGO_TRACE(shortest_r, end);
+    return -1;
+}
+
+RLHK_ALGO_API
+int
+rlhk_algo_dijkstra_r(struct rlhk_algo_ctx *ctx, rlhk_algo_map m,
+                     const short *seeds, long n)
+{
+    rlhk_algo_i32 *q = ctx->queue;
+    long head = 0;
+    long tail = 0;
+    long i;
+    unsigned short epoch;
+
+    RLHK_ALGO_TRACE(dijkstra_r, begin);
+    rlhk_algo_ctx_begin(ctx);
+    epoch = ctx->epoch;
+    for (i = 0; i < n; i++) {
+        long t = rlhk_algo_ctx_index(ctx, seeds[i * 2], seeds[i * 2 + 1]);
+        if (t < 0 || ctx->stamp[t] == epoch)
+            continue;
+        if (head == ctx->queuelen) {
+            RLHK_ALGO_TRACE(dijkstra_r, end);
+            return 0; /* out of memory */
+        }
+        ctx->distance[t] = 0;
+        ctx->stamp[t] = epoch;
+        ctx->gradient[t] = 8;
+        q[head++] = t;
+    }
+
+    /* Each tile is queued at most once, so no ring is needed. */
+    RLHK_ALGO_TRACE(dijkstra_r, search);
+    while (tail != head) {
+        int d;
+        long c = q[tail++];
+        int x = ctx->x + c % ctx->width;
+        int y = ctx->y + c / ctx->width;
+        long v = ctx->distance[c];
+        RLHK_ALGO_COUNT(pops);
+        RLHK_ALGO_COUNT(expanded);
+        for (d = 0; d < 8; d++) {
+            int tx = x + RLHK_ALGO_DX(d);
+            int ty = y + RLHK_ALGO_DY(d);
+            long t = rlhk_algo_ctx_index(ctx, tx, ty);
+            if (t < 0 || ctx->stamp[t] == epoch)
+                continue;
+            if (!RLHK_ALGO_CALL(m, GET_PASSABLE, tx, ty, (d + 4) % 8))
+                continue;
+            if (head == ctx->queuelen) {
+                RLHK_ALGO_TRACE(dijkstra_r, end);
+                return 0; /* out of memory */
+            }
+            RLHK_ALGO_COUNT(pushes);
+            ctx->distance[t] = v + 1;
+            ctx->stamp[t] = epoch;
+            ctx->gradient[t] = (d + 4) % 8;
+            q[head++] = t;
+        }
+    }
+    RLHK_ALGO_TRACE(dijkstra_r, end);
+    return 1;
+}
+
+RLHK_ALGO_API
+long
+rlhk_algo_ctx_distance(const struct rlhk_algo_ctx *ctx, int x, int y)
+{
+    long i = rlhk_algo_ctx_reached(ctx, x, y);
+    if (i < 0)
+        return -1;
+    return ctx->distance[i];
+}
+
+RLHK_ALGO_API
+int
+rlhk_algo_ctx_gradient(const struct rlhk_algo_ctx *ctx, int x, int y)
+{
+    long i = rlhk_algo_ctx_reached(ctx, x, y);
+    if (i < 0 || ctx->gradient[i] > 7)
+        return -1;
+    return ctx->gradient[i];
+}
+
+RLHK_ALGO_API
+long
+rlhk_algo_ctx_route(const struct rlhk_algo_ctx *ctx, int x, int y,
+                    short *route, long max)
+{
+    long n = 0;
+    long i = rlhk_algo_ctx_reached(ctx, x, y);
+    if (i < 0)
+        return 0;
+    for (;;) {
+        int d = ctx->gradient[i];
+        if (n < max) {
+            route[n * 2 + 0] = x;
+            route[n * 2 + 1] = y;
+        }
+        n++;
+        if (d > 7)
+            return n;
+        x += RLHK_ALGO_DX(d);
+        y += RLHK_ALGO_DY(d);
+        /* Stop rather than follow a gradient out of the window. */
+        if ((i = rlhk_algo_ctx_reached(ctx, x, y)) < 0)
+            return 0;
+    }
+}
+
+/* Goals ordered by row then column. */
+static int
+rlhk_algo_query_less(const struct rlhk_algo_query *a,
+                     const struct rlhk_algo_query *b)
+{
+    return a->y1 < b->y1 || (a->y1 == b->y1 && a->x1 < b->x1);
+}
+
+static void
+rlhk_algo_batch_sift(const struct rlhk_algo_query *q, long *order,
+                     long i, long n)
+{
+    long v = order[i];
+    for (;;) {
+        long c = 2 * i + 1;
+        if (c >= n)
+            break;
+        if (c + 1 < n && rlhk_algo_query_less(q + order[c], q + order[c + 1]))
+            c++;
+        if (!rlhk_algo_query_less(q + v, q + order[c]))
+            break;
+        order[i] = order[c];
+        i = c;
+    }
+    order[i] = v;
+}
+
+RLHK_ALGO_API
+long
+rlhk_algo_batch_plan(const struct rlhk_algo_query *q, long n, long *order)
+{
+    long i;
+    long groups = 0;
+    for (i = 0; i < n; i++)
+        order[i] = i;
+    /* Heapsort: no allocation and no qsort() context to smuggle q. */
+    for (i = n / 2 - 1; i >= 0; i--)
+        rlhk_algo_batch_sift(q, order, i, n);
+    for (i = n - 1; i > 0; i--) {
+        long t = order[0];
+        order[0] = order[i];
+        order[i] = t;
+        rlhk_algo_batch_sift(q, order, 0, i);
+    }
+    for (i = 0; i < n; i++)
+        if (i == 0 || rlhk_algo_query_less(q + order[i - 1], q + order[i]))
+            groups++;
+    return groups;
+}
+
+/* Breadth-first search out from the shared goal of order[first..last),
+ * stopping early once every agent in the group has been reached.
+ * Agent tiles are pre-stamped with the impossible gradient 9.
+ *
+ * Stepping from c back to t stands for the agent's move from t into c,
+ * so passability is asked of c, entered from direction d. Tiles that
+ * can't be entered are still queued, but no move leads out of them.
+ */
+static int
+rlhk_algo_batch_flood(struct rlhk_algo_ctx *ctx, rlhk_algo_map m,
+                      const struct rlhk_algo_query *q, const long *order,
+                      long first, long last)
+{
+    rlhk_algo_i32 *queue = ctx->queue;
+    long head = 0;
+    long tail = 0;
+    long remaining = 0;
+    long i;
+    long goal = rlhk_algo_ctx_index(ctx, q[order[first]].x1,
+                                    q[order[first]].y1);
+    unsigned short epoch;
+
+    rlhk_algo_ctx_begin(ctx);
+    epoch = ctx->epoch;
+    for (i = first; i < last; i++) {
+        const struct rlhk_algo_query *r = q + order[i];
+        long t = rlhk_algo_ctx_index(ctx, r->x0, r->y0);
+        if (t >= 0 && ctx->stamp[t] != epoch) {
+            ctx->distance[t] = -1;
+            ctx->stamp[t] = epoch;
+            ctx->gradient[t] = 9;
+            remaining++;
+        }
+    }
+    if (goal < 0)
+        return 1;
+    if (ctx->stamp[goal] == epoch)
+        remaining--;
+    ctx->distance[goal] = 0;
+    ctx->stamp[goal] = epoch;
+    ctx->gradient[goal] = 8;
+    queue[head++] = goal;
+
+    while (remaining && tail != head) {
+        int d;
+        long c = queue[tail++];
+        int x = ctx->x + c % ctx->width;
+        int y = ctx->y + c / ctx->width;
+        long v = ctx->distance[c];
+        RLHK_ALGO_COUNT(pops);
+        RLHK_ALGO_COUNT(expanded);
+        for (d = 0; d < 8; d++) {
+            int tx = x + RLHK_ALGO_DX(d);
+            int ty = y + RLHK_ALGO_DY(d);
+            long t = rlhk_algo_ctx_index(ctx, tx, ty);
+            if (t < 0)
+                continue;
+            if (ctx->stamp[t] == epoch && ctx->gradient[t] != 9)
+                continue;
+            if (!RLHK_ALGO_CALL(m, GET_PASSABLE, x, y, d))
+                continue;
+            if (head == ctx->queuelen)
+                return 0; /* out of memory */
+            if (ctx->stamp[t] == epoch)
+                remaining--;
+            RLHK_ALGO_COUNT(pushes);
+            ctx->distance[t] = v + 1;
+            ctx->stamp[t] = epoch;
+            ctx->gradient[t] = (d + 4) % 8;
+            queue[head++] = t;
+        }
+    }
+    return 1;
+}
+
+/* Store the n-tile route from the source of the last query to (x, y),
+ * which is found backwards, keeping only its first max tiles.
+ */
+static void
+rlhk_algo_batch_reverse(const struct rlhk_algo_ctx *ctx, int x, int y,
+                        long n, short *route, long max)
+{
+    while (n--) {
+        int d = ctx->gradient[rlhk_algo_ctx_index(ctx, x, y)];
+        if (n < max) {
+            route[n * 2 + 0] = x;
+            route[n * 2 + 1] = y;
+        }
+        if (d > 7)
+            break;
+        x += RLHK_ALGO_DX(d);
+        y += RLHK_ALGO_DY(d);
+    }
+}
+
+/* The first group starting at or after position i of order. */
+static long
+rlhk_algo_batch_group(const struct rlhk_algo_query *q, const long *order,
+                      long n, long i)
+{
+    while (i > 0 && i < n && !rlhk_algo_query_less(q + order[i - 1],
+                                                   q + order[i]))
+        i++;
+    return i;
+}
+
+RLHK_ALGO_API
+void
+rlhk_algo_shortest_batch(struct rlhk_algo_ctx *ctx, rlhk_algo_map m,
+                         struct rlhk_algo_query *q, const long *order,
+                         long n, int worker, int nworkers)
+{
+    /* Split by query count without overflowing n * worker. */
+    long first = n / nworkers * worker + n % nworkers * worker / nworkers;
+    long end = n / nworkers * (worker + 1) +
+               n % nworkers * (worker + 1) / nworkers;
+    RLHK_ALGO_TRACE(shortest_batch, begin);
+    first = rlhk_algo_batch_group(q, order, n, first);
+    end = rlhk_algo_batch_group(q, order, n, end);
+    while (first < end) {
+        long i;
+        long last = first + 1;
+        while (last < n && !rlhk_algo_query_less(q + order[first],
+                                                 q + order[last]))
+            last++;
+
+        RLHK_ALGO_TRACE(shortest_batch, search);
+        if (last - first == 1) {
+            struct rlhk_algo_query *r = q + order[first];
+            r->length = rlhk_algo_shortest_r(ctx, m, r->x0, r->y0,
+                                             r->x1, r->y1);
+        } else if (!rlhk_algo_batch_flood(ctx, m, q, order, first, last)) {
+            for (i = first; i < last; i++)
+                q[order[i]].length = -2;
+            first = last;
+            continue;
+        } else {
+            for (i = first; i < last; i++) {
+                struct rlhk_algo_query *r = q + order[i];
+                long t = rlhk_algo_ctx_index(ctx, r->x0, r->y0);
+                if (t < 0 || ctx->stamp[t] != ctx->epoch ||
+                    ctx->gradient[t] == 9)
+                    r->length = -1;
+                else
+                    r->length = ctx->distance[t];
+            }
+        }
+
+        RLHK_ALGO_TRACE(shortest_batch, reconstruct);
+        for (i = first; i < last; i++) {
+            struct rlhk_algo_query *r = q + order[i];
+            if (r->length < 0)
+                continue;
+            if (last - first == 1)
+                rlhk_algo_batch_reverse(ctx, r->x1, r->y1, r->length + 1,
+                                        r->route, r->max);
+            else
+                rlhk_algo_ctx_route(ctx, r->x0, r->y0, r->route, r->max);
+        }
+        first = last;
+    }
+    RLHK_ALGO_TRACE(shortest_batch, end);
+}
+
+#define RLHK_ALGO_WBITS ((int)(CHAR_BIT * sizeof(unsigned long)))
+
+/* Scratch for one rlhk_algo_dijkstra_many() worker. The frontier is
+ * kept as a bitboard plus an ascending list of its non-empty rows,
+ * and each row tracks the span of words [lo, hi] that may be
+ * non-zero, so thin frontiers (corridors, mazes) only cost the words
+ * they touch.
+ */
+struct rlhk_algo_many {
+    int stride;
+    unsigned long *visited;
+    unsigned long *cur;
+    unsigned long *next;
+    int *curlo;
+    int *curhi;
+    int *nextlo;
+    int *nexthi;
+    int *currows;
+    int *nextrows;
+    int ncur;
+};
+
+/* Write distance d for every set bit of the new frontier word. */
+static void
+rlhk_algo_many_mark(rlhk_algo_i32 *distance, long base, unsigned long n,
+                    long d)
+{
+    long x = base;
+    while (n) {
+        if (!(n & 0xff)) {
+            n >>= 8;
+            x += 8;
+            continue;
+        }
+        if (n & 1) {
+            RLHK_ALGO_COUNT(expanded);
+            distance[x] = d;
+        }
+        n >>= 1;
+        x++;
+    }
+}
+
+/* Dilate the frontier rows around y into row y of the next frontier.
+ * Returns non-zero if any tile was reached.
+ */
+static int
+rlhk_algo_many_row(struct rlhk_algo_many *s, rlhk_algo_i32 *distance,
+                   int width, int height, int y, long d)
+{
+    int r, w;
+    int stride = s->stride;
+    int lo = stride;
+    int hi = -1;
+    unsigned long prev, cur, next;
+    unsigned long *visited = s->visited + (long)y * stride;
+
+    for (r = y - 1; r <= y + 1; r++) {
+        if (r < 0 || r >= height || s->curlo[r] > s->curhi[r])
+            continue;
+        lo = s->curlo[r] < lo ? s->curlo[r] : lo;
+        hi = s->curhi[r] > hi ? s->curhi[r] : hi;
+    }
+    if (lo > hi)
+        return 0;
+    lo = lo > 0 ? lo - 1 : 0;
+    hi = hi < stride - 1 ? hi + 1 : stride - 1;
+
+    /* Vertical dilation is an OR of three rows, then horizontal
+     * dilation shifts in bits from the neighbouring words.
+     */
+    prev = 0;
+    cur = 0;
+    for (r = y - 1; r <= y + 1; r++)
+        if (r >= 0 && r < height)
+            cur |= s->cur[(long)r * stride + lo];
+    for (w = lo; w <= hi; w++) {
+        unsigned long h, n;
+        next = 0;
+        if (w + 1 < stride)
+            for (r = y - 1; r <= y + 1; r++)
+                if (r >= 0 && r < height)
+                    next |= s->cur[(long)r * stride + w + 1];
+        h = cur | cur << 1 | cur >> 1 |
+            prev >> (RLHK_ALGO_WBITS - 1) |
+            next << (RLHK_ALGO_WBITS - 1);
+        n = h & ~visited[w];
+        if (n) {
+            visited[w] |= n;
+            s->next[(long)y * stride + w] = n;
+            if (s->nextlo[y] > w)
+                s->nextlo[y] = w;
+            s->nexthi[y] = w;
+            rlhk_algo_many_mark(distance,
+                                (long)y * width + (long)w * RLHK_ALGO_WBITS,
+                                n, d);
+        }
+        prev = cur;
+        cur = next;
+    }
+    return s->nextlo[y] <= s->nexthi[y];
+}
+
+/* Advance the frontier one step, to distance d. */
+static void
+rlhk_algo_many_step(struct rlhk_algo_many *s, rlhk_algo_i32 *distance,
+                    int width, int height, long d)
+{
+    int i, nnext = 0;
+    int last = -2;
+
+    /* Candidate rows are each frontier row and its two neighbours,
+     * visited in ascending order without repeats.
+     */
+    for (i = 0; i < s->ncur; i++) {
+        int y;
+        int r = s->currows[i];
+        for (y = r - 1; y <= r + 1; y++) {
+            if (y <= last || y < 0 || y >= height)
+                continue;
+            last = y;
+            if (rlhk_algo_many_row(s, distance, width, height, y, d))
+                s->nextrows[nnext++] = y;
+        }
+    }
+
+    /* Retire the old frontier and swap. */
+    for (i = 0; i < s->ncur; i++) {
+        int w;
+        int y = s->currows[i];
+        for (w = s->curlo[y]; w <= s->curhi[y]; w++)
+            s->cur[(long)y * s->stride + w] = 0;
+        s->curlo[y] = s->stride;
+        s->curhi[y] = -1;
+    }
+    {
+        unsigned long *t = s->cur;
+        int *tlo = s->curlo;
+        int *thi = s->curhi;
+        int *trows = s->currows;
+        s->cur = s->next;
+        s->curlo = s->nextlo;
+        s->curhi = s->nexthi;
+        s->currows = s->nextrows;
+        s->next = t;
+        s->nextlo = tlo;
+        s->nexthi = thi;
+        s->nextrows = trows;
+    }
+    s->ncur = nnext;
+}
+
+RLHK_ALGO_API
+int
+rlhk_algo_dijkstra_many(const unsigned long *walls, int width, int height,
+                        struct rlhk_algo_field *fields, int nfields,
+                        void *buf, long buflen, int worker, int nworkers)
+{
+    struct rlhk_algo_many s;
+    long words;
+    int f, y;
+    int tail = width % RLHK_ALGO_WBITS;
+    unsigned long pad = tail ? ~0UL << tail : 0;
+
+    if (width < 1 || height < 1 ||
+        buflen < RLHK_ALGO_MANY_BUFLEN(width, height))
+        return 0;
+    s.stride = (width + RLHK_ALGO_WBITS - 1) / RLHK_ALGO_WBITS;
+    words = (long)height * s.stride;
+    s.visited = buf;
+    s.cur = s.visited + words;
+    s.next = s.cur + words;
+    s.curlo = (int *)(s.next + words);
+    s.curhi = s.curlo + height;
+    s.nextlo = s.curhi + height;
+    s.nexthi = s.nextlo + height;
+    s.currows = s.nexthi + height;
+    s.nextrows = s.currows + height;
+    memset(s.cur, 0, sizeof(unsigned long) * words * 2);
+    for (y = 0; y < height; y++) {
+        s.curlo[y] = s.nextlo[y] = s.stride;
+        s.curhi[y] = s.nexthi[y] = -1;
+    }
+
+    RLHK_ALGO_TRACE(dijkstra_many, begin);
+    for (f = worker; f < nfields; f += nworkers) {
+        struct rlhk_algo_field *field = fields + f;
+        long i, d;
+
+        /* Padding bits past the right edge count as walls. */
+        memcpy(s.visited, walls, sizeof(unsigned long) * words);
+        for (y = 0; y < height; y++)
+            s.visited[(long)y * s.stride + s.stride - 1] |= pad;
+        for (i = 0; i < (long)width * height; i++)
+            field->distance[i] = -1;
+
+        for (i = 0; i < field->nseeds; i++) {
+            int x = field->seeds[i * 2 + 0];
+            int w;
+            unsigned long bit;
+            long row;
+            y = field->seeds[i * 2 + 1];
+            if (x < 0 || y < 0 || x >= width || y >= height)
+                continue;
+            w = x / RLHK_ALGO_WBITS;
+            bit = 1UL << (x % RLHK_ALGO_WBITS);
+            row = (long)y * s.stride;
+            field->distance[(long)y * width + x] = 0;
+            s.visited[row + w] |= bit;
+            s.cur[row + w] |= bit;
+            if (s.curlo[y] > w)
+                s.curlo[y] = w;
+            if (s.curhi[y] < w)
+                s.curhi[y] = w;
+        }
+        s.ncur = 0;
+        for (y = 0; y < height; y++)
+            if (s.curlo[y] <= s.curhi[y])
+                s.currows[s.ncur++] = y;
+
+        RLHK_ALGO_TRACE(dijkstra_many, search);
+        for (d = 1; s.ncur; d++)
+            rlhk_algo_many_step(&s, field->distance, width, height, d);
+    }
+    RLHK_ALGO_TRACE(dijkstra_many, end);
+    return 1;
+}
+
+RLHK_ALGO_API
+int
+rlhk_algo_diffuse_init(struct rlhk_algo_diffuse *d, int width, int height,
+                       void *buf, long buflen)
+{
+    long n = (long)(width + 2) * (height + 2);
+    if (width < 1 || height < 1 ||
+        buflen < RLHK_ALGO_DIFFUSE_BUFLEN(width, height))
+        return 0;
+    d->grid = buf;
+    d->scratch = d->grid + n;
+    d->width = width;
+    d->height = height;
+    d->stride = width + 2;
+    d->x0 = d->y0 = 0;
+    d->x1 = d->y1 = -1;
+    memset(buf, 0, sizeof(float) * n * 2);
+    return 1;
+}
+
+RLHK_ALGO_API
+void
+rlhk_algo_diffuse_add(struct rlhk_algo_diffuse *d, int x, int y,
+                      float amount)
+{
+    if (x < 0 || y < 0 || x >= d->width || y >= d->height)
+        return;
+    d->grid[(long)(y + 1) * d->stride + x + 1] += amount;
+    if (d->x0 > d->x1) {
+        d->x0 = d->x1 = x;
+        d->y0 = d->y1 = y;
+        return;
+    }
+    d->x0 = x < d->x0 ? x : d->x0;
+    d->x1 = x > d->x1 ? x : d->x1;
+    d->y0 = y < d->y0 ? y : d->y0;
+    d->y1 = y > d->y1 ? y : d->y1;
+}
+
+RLHK_ALGO_API
+float
+rlhk_algo_diffuse_get(const struct rlhk_algo_diffuse *d, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= d->width || y >= d->height)
+        return 0;
+    return d->grid[(long)(y + 1) * d->stride + x + 1];
+}
+
+RLHK_ALGO_API
+void
+rlhk_algo_diffuse_step(struct rlhk_algo_diffuse *d, const float *keep,
+                       float rate, float cutoff)
+{
+    int x, y;
+    int x0, y0, x1, y1;
+    int nx0 = d->width, ny0 = d->height, nx1 = -1, ny1 = -1;
+    float self = 1 - rate;
+    float side = rate / 4;
+    float *t;
+
+    if (d->x0 > d->x1)
+        return;
+    RLHK_ALGO_TRACE(diffuse, begin);
+    x0 = d->x0 > 0 ? d->x0 - 1 : 0;
+    y0 = d->y0 > 0 ? d->y0 - 1 : 0;
+    x1 = d->x1 < d->width - 1 ? d->x1 + 1 : d->width - 1;
+    y1 = d->y1 < d->height - 1 ? d->y1 + 1 : d->height - 1;
+
+    /* Thanks to the zero border, rows are straight-line loops with no
+     * edge cases, which compilers vectorize.
+     */
+    for (y = y0; y <= y1; y++) {
+        const float *c = d->grid + (long)(y + 1) * d->stride + 1;
+        const float *n = c - d->stride;
+        const float *s = c + d->stride;
+        const float *k = keep + (long)y * d->width;
+        float *o = d->scratch + (long)(y + 1) * d->stride + 1;
+        int lo, hi;
+        for (x = x0; x <= x1; x++) {
+            float v = k[x] * (self * c[x] +
+                              side * (n[x] + s[x] + c[x - 1] + c[x + 1]));
+            o[x] = v < cutoff ? 0 : v;
+        }
+        lo = x0;
+        while (lo <= x1 && o[lo] == 0)
+            lo++;
+        if (lo > x1)
+            continue;
+        hi = x1;
+        while (o[hi] == 0)
+            hi--;
+        nx0 = lo < nx0 ? lo : nx0;
+        nx1 = hi > nx1 ? hi : nx1;
+        ny0 = y < ny0 ? y : ny0;
+        ny1 = y;
+    }
+
+    /* Zero the old rectangle so the next scratch starts clean. */
+    for (y = d->y0; y <= d->y1; y++) {
+        float *c = d->grid + (long)(y + 1) * d->stride + 1;
+        for (x = d->x0; x <= d->x1; x++)
+            c[x] = 0;
+    }
+    t = d->grid;
+    d->grid = d->scratch;
+    d->scratch = t;
+    if (nx1 < 0) {
+        d->x0 = d->y0 = 0;
+        d->x1 = d->y1 = -1;
+    } else {
+        d->x0 = nx0;
+        d->y0 = ny0;
+        d->x1 = nx1;
+        d->y1 = ny1;
+    }
+    RLHK_ALGO_TRACE(diffuse, end);
+}
+
 #endif /* RLHK_ALGO_IMPLEMENTATION */
 #endif /* RLHK_ALGO_H */
@@ -0,0 +1,401 @@
+/* Roguelike Header Kit : Chunked Maps
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Provides a fixed-capacity cache of map chunks for worlds that don't
+ * fit in 16-bit coordinates, or that are generated lazily and are too
+ * large to hold in memory at once. The world is divided into square
+ * chunks of RLHK_CHUNK_SIZE tiles per side. Each chunk is identified
+ * by a pair of 32-bit chunk coordinates, and each tile within a chunk
+ * by a pair of local offsets in [0, RLHK_CHUNK_SIZE). Only chunks that
+ * have actually been touched are resident, so memory use follows the
+ * explored area rather than the size of the world.
+ *
+ * This header does not store any tile data itself. The cache has a
+ * fixed number of slots, and a slot index selects your own per-chunk
+ * storage (e.g. an array of chunk structs indexed by slot). Chunks
+ * are loaded, generated, evicted, and cleared through
+ * rlhk_chunk_call(), which you must implement after typedef-ing
+ * rlhk_chunk_world, in the same manner as rlhk_algo_map_call().
+ *
+ * The rlhk_algo.h functions work across chunk boundaries by running
+ * in a window around some origin chunk. Pass coordinates relative to
+ * the origin chunk to rlhk_algo.h, and have your rlhk_algo_map_call()
+ * resolve them with rlhk_chunk_locate() (tile data) or
+ * rlhk_chunk_scratch() (per-query distances, heuristics, gradients).
+ * For example:
+ *
+ *     case RLHK_ALGO_MAP_GET_PASSABLE:
+ *         s = rlhk_chunk_locate(w->cache, w, w->ocx, w->ocy,
+ *                               x, y, &lx, &ly);
+ *         return s >= 0 && !w->chunks[s].wall[ly][lx];
+ *     case RLHK_ALGO_MAP_CLEAR_DISTANCE:
+ *         rlhk_chunk_epoch(w->cache);
+ *         return 0;
+ *     case RLHK_ALGO_MAP_GET_DISTANCE:
+ *         s = rlhk_chunk_scratch(w->cache, w, w->ocx, w->ocy,
+ *                                x, y, &lx, &ly);
+ *         return s >= 0 ? w->chunks[s].dist[ly][lx] : 0;
+ *
+ * Clearing distances is O(1): the cache lazily asks you to clear the
+ * scratch storage of each chunk the first time it's touched after
+ * rlhk_chunk_epoch(). Chunks holding live scratch are never evicted,
+ * so a search that outgrows the cache sees a -1 slot, which should be
+ * treated as impassable, rather than corrupted distances.
+ *
+ * Functions:
+ *   - rlhk_chunk_init
+ *   - rlhk_chunk_locate
+ *   - rlhk_chunk_scratch
+ *   - rlhk_chunk_epoch
+ *   - rlhk_chunk_flush
+ */
+#ifndef RLHK_CHUNK_H
+#define RLHK_CHUNK_H
+
+#ifndef RLHK_CHUNK_API
+#  ifdef RLHK_API
+#    define RLHK_CHUNK_API RLHK_API
+#  else
+#    define RLHK_CHUNK_API
+#  endif
+#endif
+
+/* Chunks are (1 << RLHK_CHUNK_BITS) tiles on each side. */
+#ifndef RLHK_CHUNK_BITS
+#  define RLHK_CHUNK_BITS 5
+#endif
+#define RLHK_CHUNK_SIZE (1 << RLHK_CHUNK_BITS)
+
+enum rlhk_chunk_method {
+    /**
+     * Fill the given slot with the previously-saved chunk (cx, cy).
+     * Return non-zero if the chunk was loaded, or 0 if the chunk has
+     * never been saved, in which case RLHK_CHUNK_GENERATE follows.
+     */
+    RLHK_CHUNK_LOAD,
+
+    /**
+     * Generate the new chunk (cx, cy) into the given slot. Return
+     * non-zero on success or 0 on failure, in which case the chunk
+     * remains non-resident.
+     */
+    RLHK_CHUNK_GENERATE,
+
+    /**
+     * Chunk (cx, cy) is about to be dropped from the given slot. Save
+     * it now if it has been modified. The return value is ignored.
+     */
+    RLHK_CHUNK_EVICT,
+
+    /**
+     * Reset the per-query scratch storage of the chunk in the given
+     * slot, i.e. set every tile's distance to -1. This is the chunked
+     * equivalent of RLHK_ALGO_MAP_CLEAR_DISTANCE. The return value is
+     * ignored.
+     */
+    RLHK_CHUNK_CLEAR
+};
+
+/**
+ * Generic world interface provided to the chunk cache.
+ *
+ * It is *your* job to implement this function, and to typedef
+ * "rlhk_chunk_world" to your own world type (typically as a pointer
+ * type) before including this header. The "slot" argument is the
+ * index of your per-chunk storage, in [0, nslots).
+ */
+RLHK_CHUNK_API
+long rlhk_chunk_call(rlhk_chunk_world world,
+                     enum rlhk_chunk_method method,
+                     long cx, long cy, long slot);
+
+struct rlhk_chunk_slot {
+    long cx;
+    long cy;
+    unsigned long epoch;
+    int used;
+    int ref;
+};
+
+struct rlhk_chunk_cache {
+    struct rlhk_chunk_slot *slots;
+    long *table;
+    long nslots;
+    long mask;
+    long hand;
+    long last;
+    unsigned long epoch;
+};
+
+/**
+ * Prepare a chunk cache with nslots slots.
+ *
+ * You must provide some memory (buf) and its size in bytes (buflen)
+ * for the cache's own bookkeeping. The memory need not be
+ * initialized. A buflen of "(sizeof(struct rlhk_chunk_slot) +
+ * sizeof(long) * 4) * nslots" will always be sufficient.
+ *
+ * Returns 1 on success or 0 if buflen is too small.
+ */
+RLHK_CHUNK_API
+int rlhk_chunk_init(struct rlhk_chunk_cache *cache, long nslots,
+                    void *buf, long buflen);
+
+/**
+ * Find the slot holding tile (x, y) relative to chunk (cx, cy).
+ *
+ * The relative tile coordinates may lie outside chunk (cx, cy), in
+ * which case they're resolved into the proper neighboring chunk. The
+ * tile's local offsets within its chunk are stored in lx and ly. The
+ * chunk is loaded or generated if not already resident, evicting the
+ * least recently used chunk when all slots are taken.
+ *
+ * Returns the slot index, or -1 if the chunk couldn't be made
+ * resident.
+ */
+RLHK_CHUNK_API
+long rlhk_chunk_locate(struct rlhk_chunk_cache *cache,
+                       rlhk_chunk_world world,
+                       long cx, long cy, int x, int y, int *lx, int *ly);
+
+/**
+ * Like rlhk_chunk_locate(), but for accessing per-query scratch.
+ *
+ * If the chunk's scratch storage hasn't been used since the last
+ * rlhk_chunk_epoch(), RLHK_CHUNK_CLEAR is called on it first. The
+ * chunk is then pinned until the next rlhk_chunk_epoch().
+ *
+ * Returns the slot index, or -1 if the chunk couldn't be made
+ * resident.
+ */
+RLHK_CHUNK_API
+long rlhk_chunk_scratch(struct rlhk_chunk_cache *cache,
+                        rlhk_chunk_world world,
+                        long cx, long cy, int x, int y, int *lx, int *ly);
+
+/**
+ * Logically clear all per-query scratch storage and unpin all chunks.
+ */
+RLHK_CHUNK_API
+void rlhk_chunk_epoch(struct rlhk_chunk_cache *cache);
+
+/**
+ * Evict every resident chunk, e.g. before saving and exiting.
+ */
+RLHK_CHUNK_API
+void rlhk_chunk_flush(struct rlhk_chunk_cache *cache,
+                      rlhk_chunk_world world);
+
+/* Implementation */
+#if defined(RLHK_IMPLEMENTATION) || defined(RLHK_CHUNK_IMPLEMENTATION)
+
+static unsigned long
+rlhk_chunk_hash(long cx, long cy)
+{
+    unsigned long h = (unsigned long)cx * 0x9e3779b1UL;
+    h ^= (unsigned long)cy * 0x85ebca6bUL;
+    h &= 0xffffffffUL;
+    return h ^ (h >> 16);
+}
+
+RLHK_CHUNK_API
+int
+rlhk_chunk_init(struct rlhk_chunk_cache *cache, long nslots,
+                void *buf, long buflen)
+{
+    long i;
+    long tablelen = 1;
+    long slotlen = sizeof(struct rlhk_chunk_slot);
+    /* Bounding nslots by buflen first keeps the sizes below from
+     * overflowing.
+     */
+    if (nslots < 1 || nslots > buflen / slotlen)
+        return 0;
+    while (tablelen < nslots * 2)
+        tablelen *= 2;
+    if ((buflen - slotlen * nslots) / (long)sizeof(long) < tablelen)
+        return 0;
+
+    cache->slots = buf;
+    cache->table = (long *)(cache->slots + nslots);
+    cache->nslots = nslots;
+    cache->mask = tablelen - 1;
+    cache->hand = 0;
+    cache->last = -1;
+    cache->epoch = 1;
+    for (i = 0; i < nslots; i++) {
+        cache->slots[i].used = 0;
+        cache->slots[i].ref = 0;
+        cache->slots[i].epoch = 0;
+    }
+    for (i = 0; i < tablelen; i++)
+        cache->table[i] = -1;
+    return 1;
+}
+
+static long
+rlhk_chunk_probe(struct rlhk_chunk_cache *cache, long cx, long cy)
+{
+    long i = rlhk_chunk_hash(cx, cy) & cache->mask;
+    for (;;) {
+        long s = cache->table[i];
+        if (s == -1)
+            return i;
+        if (cache->slots[s].cx == cx && cache->slots[s].cy == cy)
+            return i;
+        i = (i + 1) & cache->mask;
+    }
+}
+
+static void
+rlhk_chunk_unlink(struct rlhk_chunk_cache *cache, long cx, long cy)
+{
+    /* Linear probing deletion with backward shift. */
+    long i = rlhk_chunk_probe(cache, cx, cy);
+    long j = i;
+    cache->table[i] = -1;
+    for (;;) {
+        long s, k;
+        j = (j + 1) & cache->mask;
+        if ((s = cache->table[j]) == -1)
+            break;
+        k = rlhk_chunk_hash(cache->slots[s].cx, cache->slots[s].cy) &
+            cache->mask;
+        if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+            cache->table[i] = s;
+            cache->table[j] = -1;
+            i = j;
+        }
+    }
+}
+
+static long
+rlhk_chunk_victim(struct rlhk_chunk_cache *cache)
+{
+    /* CLOCK approximation of LRU, skipping pinned slots. */
+    long n;
+    for (n = 0; n < cache->nslots * 2; n++) {
+        long s = cache->hand;
+        struct rlhk_chunk_slot *slot = cache->slots + s;
+        cache->hand = (cache->hand + 1) % cache->nslots;
+        if (!slot->used)
+            return s;
+        if (slot->epoch == cache->epoch)
+            continue;
+        if (slot->ref)
+            slot->ref = 0;
+        else
+            return s;
+    }
+    return -1;
+}
+
+static long
+rlhk_chunk_find(struct rlhk_chunk_cache *cache, rlhk_chunk_world world,
+                long cx, long cy)
+{
+    long i, s;
+    struct rlhk_chunk_slot *slot;
+
+    /* Consecutive lookups usually hit the same chunk. */
+    s = cache->last;
+    if (s >= 0 && cache->slots[s].cx == cx && cache->slots[s].cy == cy) {
+        cache->slots[s].ref = 1;
+        return s;
+    }
+
+    i = rlhk_chunk_probe(cache, cx, cy);
+    if ((s = cache->table[i]) != -1) {
+        cache->slots[s].ref = 1;
+        return cache->last = s;
+    }
+
+    if ((s = rlhk_chunk_victim(cache)) == -1)
+        return -1;
+    slot = cache->slots + s;
+    if (slot->used) {
+        rlhk_chunk_call(world, RLHK_CHUNK_EVICT, slot->cx, slot->cy, s);
+        rlhk_chunk_unlink(cache, slot->cx, slot->cy);
+        slot->used = 0;
+        if (cache->last == s)
+            cache->last = -1;
+    }
+    if (!rlhk_chunk_call(world, RLHK_CHUNK_LOAD, cx, cy, s) &&
+        !rlhk_chunk_call(world, RLHK_CHUNK_GENERATE, cx, cy, s))
+        return -1;
+
+    slot->cx = cx;
+    slot->cy = cy;
+    slot->used = 1;
+    slot->ref = 1;
+    slot->epoch = 0;
+    cache->table[rlhk_chunk_probe(cache, cx, cy)] = s;
+    return cache->last = s;
+}
+
+static void
+rlhk_chunk_split(long *c, int v, int *l)
+{
+    /* Floored division, since v may be negative. */
+    int q = v >= 0 ? v / RLHK_CHUNK_SIZE : -((-v - 1) / RLHK_CHUNK_SIZE) - 1;
+    *c += q;
+    *l = v - q * RLHK_CHUNK_SIZE;
+}
+
+RLHK_CHUNK_API
+long
+rlhk_chunk_locate(struct rlhk_chunk_cache *cache, rlhk_chunk_world world,
+                  long cx, long cy, int x, int y, int *lx, int *ly)
+{
+    rlhk_chunk_split(&cx, x, lx);
+    rlhk_chunk_split(&cy, y, ly);
+    return rlhk_chunk_find(cache, world, cx, cy);
+}
+
+RLHK_CHUNK_API
+long
+rlhk_chunk_scratch(struct rlhk_chunk_cache *cache, rlhk_chunk_world world,
+                   long cx, long cy, int x, int y, int *lx, int *ly)
+{
+    long s = rlhk_chunk_locate(cache, world, cx, cy, x, y, lx, ly);
+    if (s >= 0 && cache->slots[s].epoch != cache->epoch) {
+        struct rlhk_chunk_slot *slot = cache->slots + s;
+        rlhk_chunk_call(world, RLHK_CHUNK_CLEAR, slot->cx, slot->cy, s);
+        slot->epoch = cache->epoch;
+    }
+    return s;
+}
+
+RLHK_CHUNK_API
+void
+rlhk_chunk_epoch(struct rlhk_chunk_cache *cache)
+{
+    if (!++cache->epoch) {
+        /* Wrapped around: forget every stamp. */
+        long i;
+        for (i = 0; i < cache->nslots; i++)
+            cache->slots[i].epoch = 0;
+        cache->epoch = 1;
+    }
+}
+
+RLHK_CHUNK_API
+void
+rlhk_chunk_flush(struct rlhk_chunk_cache *cache, rlhk_chunk_world world)
+{
+    long i;
+    for (i = 0; i < cache->nslots; i++) {
+        struct rlhk_chunk_slot *slot = cache->slots + i;
+        if (slot->used) {
+            rlhk_chunk_call(world, RLHK_CHUNK_EVICT, slot->cx, slot->cy, i);
+            slot->used = 0;
+        }
+    }
+    for (i = 0; i <= cache->mask; i++)
+        cache->table[i] = -1;
+    cache->last = -1;
+}
+
+#endif /* RLHK_CHUNK_IMPLEMENTATION */
+#endif /* RLHK_CHUNK_H */
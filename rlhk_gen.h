@@ -0,0 +1,738 @@
+/* Roguelike Header Kit : Map Generation
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Provides map generators that operate on packed bitboards. A bitboard
+ * is an array of unsigned long words, RLHK_GEN_STRIDE(width) words per
+ * row, one bit per tile. Tile (x, y) is bit (x % RLHK_GEN_WBITS) of
+ * word (y * stride + x / RLHK_GEN_WBITS). Unless stated otherwise a
+ * set bit is a wall and a clear bit is open floor. Padding bits past
+ * the width of each row are always kept clear.
+ *
+ * Use RLHK_GEN_GET() to read tiles back out of a bitboard, such as
+ * from within rlhk_algo_map_call().
+ *
+ * Randomized generators are seeded through rlhk_rand.h, so they take
+ * the same generator state as rlhk_rand_32() and are reproducible for
+ * a given seed.
+ *
+ * Functions:
+ *   - rlhk_gen_clear
+ *   - rlhk_gen_carve
+ *   - rlhk_gen_ca
+ *   - rlhk_gen_ca_rows
+ *   - rlhk_gen_bsp
+ *   - rlhk_gen_noise
+ *   - rlhk_gen_poisson
+ */
+#ifndef RLHK_GEN_H
+#define RLHK_GEN_H
+
+#ifndef RLHK_GEN_API
+#  ifdef RLHK_API
+#    define RLHK_GEN_API RLHK_API
+#  else
+#    define RLHK_GEN_API
+#  endif
+#endif
+
+#include "rlhk_rand.h"
+#include <limits.h>
+
+#define RLHK_GEN_WBITS ((int)sizeof(unsigned long) * 8)
+#define RLHK_GEN_STRIDE(w) (((w) + RLHK_GEN_WBITS - 1) / RLHK_GEN_WBITS)
+#define RLHK_GEN_GET(b, w, x, y) \
+    ((int)((b)[(y) * RLHK_GEN_STRIDE(w) + (x) / RLHK_GEN_WBITS] >> \
+           ((x) % RLHK_GEN_WBITS)) & 1)
+#define RLHK_GEN_SET(b, w, x, y) \
+    ((b)[(y) * RLHK_GEN_STRIDE(w) + (x) / RLHK_GEN_WBITS] |= \
+     1UL << ((x) % RLHK_GEN_WBITS))
+#define RLHK_GEN_CLR(b, w, x, y) \
+    ((b)[(y) * RLHK_GEN_STRIDE(w) + (x) / RLHK_GEN_WBITS] &= \
+     ~(1UL << ((x) % RLHK_GEN_WBITS)))
+
+/**
+ * Set every tile of a bitboard to the given value (0 or 1).
+ */
+RLHK_GEN_API
+void rlhk_gen_clear(unsigned long *map, int width, int height, int value);
+
+/**
+ * Clear (open up) the inclusive rectangle from (x0, y0) to (x1, y1).
+ * The corners may be given in any order but must lie within the map.
+ */
+RLHK_GEN_API
+void rlhk_gen_carve(unsigned long *map, int width,
+                    int x0, int y0, int x1, int y1);
+
+/**
+ * A cellular automaton rule. Bit n of "birth" means a clear tile with
+ * n set neighbors becomes set, and bit n of "survive" means a set tile
+ * with n set neighbors stays set. Tiles outside the map count as
+ * "edge" (0 or 1).
+ *
+ * For example, Conway's Life (B3/S23) is {1 << 3, 1 << 2 | 1 << 3, 0},
+ * and the classic "4-5" cave smoothing rule, where a tile becomes a
+ * wall when 5 or more tiles of its 3x3 block are walls, is
+ * {RLHK_GEN_CA_ATLEAST(5), RLHK_GEN_CA_ATLEAST(4), 1}.
+ */
+struct rlhk_gen_ca_rule {
+    unsigned birth;
+    unsigned survive;
+    int edge;
+};
+
+#define RLHK_GEN_CA_ATLEAST(n) (0x1ffu & (0x1ffu << (n)))
+
+/**
+ * Run a cellular automaton over a bitboard for a number of iterations.
+ *
+ * Neighbor counts are computed with bit-sliced adders, processing a
+ * whole word of tiles at a time. You must provide a second bitboard
+ * (tmp) of the same size as work space. The result is left in map.
+ */
+RLHK_GEN_API
+void rlhk_gen_ca(unsigned long *map, unsigned long *tmp,
+                 int width, int height,
+                 const struct rlhk_gen_ca_rule *rule, int iterations);
+
+/**
+ * Run a single cellular automaton iteration over rows [y0, y1) only,
+ * reading from src and writing to dst.
+ *
+ * This is the building block of rlhk_gen_ca(). Since rows only depend
+ * on src, disjoint row bands may be computed concurrently, e.g. by a
+ * pool of threads for very large maps, so long as every band finishes
+ * before the buffers are swapped for the next iteration.
+ */
+RLHK_GEN_API
+void rlhk_gen_ca_rows(unsigned long *dst, const unsigned long *src,
+                      int width, int height,
+                      const struct rlhk_gen_ca_rule *rule, int y0, int y1);
+
+/**
+ * Generate a room-and-corridor dungeon by binary space partitioning.
+ *
+ * The map is filled with walls, then recursively split into leaves
+ * until no leaf exceeds maxleaf tiles on a side, never cutting a leaf
+ * smaller than minleaf (at least 5). Each leaf receives one room, and
+ * the two halves of every split are joined with an L-shaped corridor.
+ * Since every split is joined, all open tiles are connected by
+ * construction and no flood fill validation is needed. The outermost
+ * border of the map is always left solid.
+ *
+ * Only the smaller half of each split is recursed into, so recursion
+ * depth is at most log2 of the map area.
+ */
+RLHK_GEN_API
+void rlhk_gen_bsp(unsigned long *map, int width, int height,
+                  unsigned long *rng, int minleaf, int maxleaf);
+
+/* Fixed-point 1.0 of rlhk_gen_noise(). */
+#define RLHK_GEN_NOISE_ONE 4096
+
+/**
+ * Fill a width by height grid (row-major) with fractal Perlin noise
+ * for the rectangle of the plane whose top-left tile is (x0, y0).
+ *
+ * The first octave has lattice cells of 2^shift tiles (shift from 1
+ * to 12), and each of the following octaves halves the cell size and
+ * the amplitude, up to shift octaves. Each octave lies within
+ * RLHK_GEN_NOISE_ONE either side of 0, so the sum lies within twice
+ * that.
+ *
+ * The noise is computed in integer arithmetic from rlhk_rand_at(), so
+ * it's identical on every platform, and any rectangle of the same
+ * seed lines up seamlessly with its neighbors, such as when chunks of
+ * an overworld are generated lazily. Take the seed from rlhk_rand_32()
+ * for a reproducible map. Within each lattice cell the inner loop is
+ * branch-free arithmetic across x, so the compiler can vectorize it.
+ */
+RLHK_GEN_API
+void rlhk_gen_noise(short *grid, int width, int height, long x0, long y0,
+                    int shift, int octaves, unsigned long seed);
+
+/* Background grid cell size for a Poisson-disk radius. Any two tiles
+ * of a cell are closer than the radius, so a cell holds one sample.
+ */
+#define RLHK_GEN_POISSON_CELL(r) ((r) * 7 / 10 + 1)
+
+/**
+ * Always-sufficient rlhk_gen_poisson() buffer size, in bytes.
+ */
+#define RLHK_GEN_POISSON_BUFLEN(width, height, radius) \
+    ((long)(2 * sizeof(long) * \
+            (((width) + RLHK_GEN_POISSON_CELL(radius) - 1) / \
+             RLHK_GEN_POISSON_CELL(radius)) * \
+            (((height) + RLHK_GEN_POISSON_CELL(radius) - 1) / \
+             RLHK_GEN_POISSON_CELL(radius))))
+
+/**
+ * Scatter points over the open tiles of a bitboard such that no two
+ * are closer than radius (Euclidean), using Bridson's Poisson-disk
+ * sampling, e.g. to place items and monsters with a minimum spacing.
+ *
+ * Each active point makes up to "tries" attempts (30 is typical) to
+ * place a neighbor between radius and twice radius away, and a final
+ * pass tries each empty background grid cell the same number of times
+ * to reach disconnected areas. The work is therefore bounded by
+ * O(tries) per point and grid cell, however dense the map. Points are
+ * stored as x, y pairs in points, up to max of them.
+ *
+ * You must provide the work space (buf) and its size in bytes
+ * (buflen), suitably aligned for a long. RLHK_GEN_POISSON_BUFLEN()
+ * gives a sufficient size.
+ *
+ * Returns the number of points, or -1 if the buffer is too small.
+ */
+RLHK_GEN_API
+long rlhk_gen_poisson(const unsigned long *map, int width, int height,
+                      int radius, int tries, unsigned long *rng,
+                      short *points, long max, void *buf, long buflen);
+
+/* Implementation */
+#if defined(RLHK_IMPLEMENTATION) || defined(RLHK_GEN_IMPLEMENTATION)
+#include <string.h>
+
+/* Mask of the valid bits in the last word of a row. */
+static unsigned long
+rlhk_gen_tail(int width)
+{
+    int n = width % RLHK_GEN_WBITS;
+    return n ? (1UL << n) - 1 : -1UL;
+}
+
+RLHK_GEN_API
+void
+rlhk_gen_clear(unsigned long *map, int width, int height, int value)
+{
+    int y;
+    long stride = RLHK_GEN_STRIDE(width);
+    unsigned long tail = rlhk_gen_tail(width);
+    memset(map, value ? 0xff : 0, sizeof(*map) * stride * height);
+    if (value)
+        for (y = 0; y < height; y++)
+            map[y * stride + stride - 1] &= tail;
+}
+
+RLHK_GEN_API
+void
+rlhk_gen_carve(unsigned long *map, int width, int x0, int y0, int x1, int y1)
+{
+    long stride = RLHK_GEN_STRIDE(width);
+    long w0, w1, i;
+    unsigned long m0, m1;
+    int y;
+    if (x1 < x0) {
+        int t = x0;
+        x0 = x1;
+        x1 = t;
+    }
+    if (y1 < y0) {
+        int t = y0;
+        y0 = y1;
+        y1 = t;
+    }
+    w0 = x0 / RLHK_GEN_WBITS;
+    w1 = x1 / RLHK_GEN_WBITS;
+    m0 = -1UL << (x0 % RLHK_GEN_WBITS);
+    m1 = -1UL >> (RLHK_GEN_WBITS - 1 - x1 % RLHK_GEN_WBITS);
+    for (y = y0; y <= y1; y++) {
+        unsigned long *row = map + y * stride;
+        if (w0 == w1) {
+            row[w0] &= ~(m0 & m1);
+        } else {
+            row[w0] &= ~m0;
+            for (i = w0 + 1; i < w1; i++)
+                row[i] = 0;
+            row[w1] &= ~m1;
+        }
+    }
+}
+
+/* Fetch word i of a row, substituting the edge value outside the map. */
+static unsigned long
+rlhk_gen_word(const unsigned long *row, long i, long stride,
+              unsigned long tail, unsigned long edge)
+{
+    if (!row || i < 0 || i >= stride)
+        return edge;
+    if (i == stride - 1)
+        return (row[i] & tail) | (edge & ~tail);
+    return row[i];
+}
+
+RLHK_GEN_API
+void
+rlhk_gen_ca_rows(unsigned long *dst, const unsigned long *src,
+                 int width, int height,
+                 const struct rlhk_gen_ca_rule *rule, int y0, int y1)
+{
+    long stride = RLHK_GEN_STRIDE(width);
+    unsigned long tail = rlhk_gen_tail(width);
+    unsigned long edge = rule->edge ? -1UL : 0;
+    int hi = RLHK_GEN_WBITS - 1;
+    int y;
+
+    for (y = y0; y < y1; y++) {
+        long i;
+        unsigned long *out = dst + y * stride;
+        const unsigned long *pn = y > 0 ? src + (y - 1) * stride : 0;
+        const unsigned long *pm = src + y * stride;
+        const unsigned long *ps = y < height - 1 ? src + (y + 1) * stride : 0;
+
+        /* Sliding window of (previous, current, next) words per row. */
+        unsigned long na = edge, ma = edge, sa = edge;
+        unsigned long nb = rlhk_gen_word(pn, 0, stride, tail, edge);
+        unsigned long mb = rlhk_gen_word(pm, 0, stride, tail, edge);
+        unsigned long sb = rlhk_gen_word(ps, 0, stride, tail, edge);
+
+        for (i = 0; i < stride; i++) {
+            unsigned long nw, nn, ne, ww, cc, ee, sw, ss, se;
+            unsigned long t0, t1, m0, m1, b0, b1, c, u0, u1, c2;
+            unsigned long s0, s1, s2, s3, r;
+            unsigned long nc = rlhk_gen_word(pn, i + 1, stride, tail, edge);
+            unsigned long mc = rlhk_gen_word(pm, i + 1, stride, tail, edge);
+            unsigned long sc = rlhk_gen_word(ps, i + 1, stride, tail, edge);
+            unsigned k;
+
+            nn = nb;
+            nw = nn << 1 | na >> hi;
+            ne = nn >> 1 | nc << hi;
+            cc = mb;
+            ww = cc << 1 | ma >> hi;
+            ee = cc >> 1 | mc << hi;
+            ss = sb;
+            sw = ss << 1 | sa >> hi;
+            se = ss >> 1 | sc << hi;
+
+            /* Sum each row of neighbors into two bits. */
+            t0 = nw ^ nn ^ ne;
+            t1 = (nw & nn) | (ne & (nw ^ nn));
+            m0 = ww ^ ee;
+            m1 = ww & ee;
+            b0 = sw ^ ss ^ se;
+            b1 = (sw & ss) | (se & (sw ^ ss));
+
+            /* Sum the three rows into a four bit count. */
+            s0 = t0 ^ m0 ^ b0;
+            c = (t0 & m0) | (b0 & (t0 ^ m0));
+            u0 = t1 ^ m1 ^ b1;
+            u1 = (t1 & m1) | (b1 & (t1 ^ m1));
+            s1 = u0 ^ c;
+            c2 = u0 & c;
+            s2 = u1 ^ c2;
+            s3 = u1 & c2;
+
+            /* Apply the rule to each possible count. */
+            r = 0;
+            for (k = 0; k <= 8; k++) {
+                unsigned long eq, want;
+                unsigned b = rule->birth >> k & 1;
+                unsigned v = rule->survive >> k & 1;
+                if (!b && !v)
+                    continue;
+                eq = (k & 1 ? s0 : ~s0) & (k & 2 ? s1 : ~s1) &
+                     (k & 4 ? s2 : ~s2) & (k & 8 ? s3 : ~s3);
+                want = b && v ? -1UL : v ? cc : ~cc;
+                r |= eq & want;
+            }
+            out[i] = r;
+
+            na = nb; nb = nc;
+            ma = mb; mb = mc;
+            sa = sb; sb = sc;
+        }
+        out[stride - 1] &= tail;
+    }
+}
+
+RLHK_GEN_API
+void
+rlhk_gen_ca(unsigned long *map, unsigned long *tmp,
+            int width, int height,
+            const struct rlhk_gen_ca_rule *rule, int iterations)
+{
+    int i;
+    unsigned long *a = map;
+    unsigned long *b = tmp;
+    for (i = 0; i < iterations; i++) {
+        unsigned long *t;
+        rlhk_gen_ca_rows(b, a, width, height, rule, 0, height);
+        t = a;
+        a = b;
+        b = t;
+    }
+    if (a != map)
+        memcpy(map, a, sizeof(*map) * RLHK_GEN_STRIDE(width) * height);
+}
+
+static int
+rlhk_gen_between(unsigned long *rng, int lo, int hi)
+{
+    return (int)rlhk_rand_between(rng, lo, hi);
+}
+
+/* Join two open tiles with an L-shaped corridor. */
+static void
+rlhk_gen_join(unsigned long *map, int width, unsigned long *rng,
+              int ax, int ay, int bx, int by)
+{
+    if (rlhk_rand_32(rng) & 1) {
+        rlhk_gen_carve(map, width, ax, ay, bx, ay);
+        rlhk_gen_carve(map, width, bx, ay, bx, by);
+    } else {
+        rlhk_gen_carve(map, width, ax, ay, ax, by);
+        rlhk_gen_carve(map, width, ax, by, bx, by);
+    }
+}
+
+/* Fill a BSP subtree and return an open tile within it. Only the
+ * smaller half of each split is recursed into; the loop carries on
+ * into the larger half, so the depth is at most log2 of the area.
+ * Each half is joined to a room of the next, which keeps the whole
+ * subtree connected without waiting for the larger half to finish.
+ */
+static void
+rlhk_gen_bsp_node(unsigned long *map, int width, unsigned long *rng,
+                  int x, int y, int w, int h, int minleaf, int maxleaf,
+                  int *px, int *py)
+{
+    int joined = 0;
+    int jx = 0, jy = 0;
+
+    for (;;) {
+        int vertical, ax, ay;
+        int canv = w >= 2 * minleaf;
+        int canh = h >= 2 * minleaf;
+
+        if ((w <= maxleaf && h <= maxleaf) || (!canv && !canh)) {
+            /* Leaf: place a room, keeping a wall margin inside the leaf. */
+            int rw = rlhk_gen_between(rng, 3, w - 2);
+            int rh = rlhk_gen_between(rng, 3, h - 2);
+            int rx = rlhk_gen_between(rng, x + 1, x + w - 1 - rw);
+            int ry = rlhk_gen_between(rng, y + 1, y + h - 1 - rh);
+            rlhk_gen_carve(map, width, rx, ry, rx + rw - 1, ry + rh - 1);
+            *px = rlhk_gen_between(rng, rx, rx + rw - 1);
+            *py = rlhk_gen_between(rng, ry, ry + rh - 1);
+            if (joined)
+                rlhk_gen_join(map, width, rng, jx, jy, *px, *py);
+            return;
+        }
+
+        if (!canh || (canv && w * 4 > h * 5))
+            vertical = 1;
+        else if (!canv || h * 4 > w * 5)
+            vertical = 0;
+        else
+            vertical = rlhk_rand_32(rng) & 1;
+
+        if (vertical) {
+            int s = rlhk_gen_between(rng, minleaf, w - minleaf);
+            if (s <= w - s) {
+                rlhk_gen_bsp_node(map, width, rng, x, y, s, h,
+                                  minleaf, maxleaf, &ax, &ay);
+                x += s;
+                w -= s;
+            } else {
+                rlhk_gen_bsp_node(map, width, rng, x + s, y, w - s, h,
+                                  minleaf, maxleaf, &ax, &ay);
+                w = s;
+            }
+        } else {
+            int s = rlhk_gen_between(rng, minleaf, h - minleaf);
+            if (s <= h - s) {
+                rlhk_gen_bsp_node(map, width, rng, x, y, w, s,
+                                  minleaf, maxleaf, &ax, &ay);
+                y += s;
+                h -= s;
+            } else {
+                rlhk_gen_bsp_node(map, width, rng, x, y + s, w, h - s,
+                                  minleaf, maxleaf, &ax, &ay);
+                h = s;
+            }
+        }
+
+        /* Both points lie inside the region being split, so the
+         * corridor between them never touches the map border. */
+        if (joined)
+            rlhk_gen_join(map, width, rng, jx, jy, ax, ay);
+        jx = ax;
+        jy = ay;
+        joined = 1;
+    }
+}
+
+RLHK_GEN_API
+void
+rlhk_gen_bsp(unsigned long *map, int width, int height,
+             unsigned long *rng, int minleaf, int maxleaf)
+{
+    int x, y;
+    if (minleaf < 5)
+        minleaf = 5;
+    if (maxleaf < minleaf)
+        maxleaf = minleaf;
+    rlhk_gen_clear(map, width, height, 1);
+    if (width < 5 || height < 5)
+        return;
+    /* Leaves keep a one tile margin, so the border stays solid. */
+    rlhk_gen_bsp_node(map, width, rng, 0, 0, width, height,
+                      minleaf, maxleaf, &x, &y);
+}
+
+/* Arithmetic right shift of v >= -2^27 by n <= 12 bits: C89 leaves
+ * shifting negative values implementation-defined, so shift with a
+ * bias instead, and noise stays identical across platforms.
+ */
+#define RLHK_GEN_SHR(v, n) ((((v) + 0x8000000) >> (n)) - (0x8000000 >> (n)))
+
+/* Noise intermediates stay below 2^29; 32-bit lanes vectorize best. */
+#if INT_MAX >= 2147483647
+typedef int rlhk_gen_i32;
+#else
+typedef long rlhk_gen_i32;
+#endif
+
+/* Perlin's quintic fade, 6t^5 - 15t^4 + 10t^3, in non-negative steps. */
+static rlhk_gen_i32
+rlhk_gen_fade(rlhk_gen_i32 t)
+{
+    rlhk_gen_i32 one = RLHK_GEN_NOISE_ONE;
+    rlhk_gen_i32 t3 = ((t * t) >> 12) * t >> 12;
+    rlhk_gen_i32 p = (6 * t * t + 10 * one * one - 15 * t * one) >> 12;
+    return t3 * p >> 12;
+}
+
+/* Gradient of lattice point ix of a row whose key is from
+ * rlhk_rand_at(), as 1, 0 or -1 per axis. One fmix32 per point.
+ */
+static void
+rlhk_gen_gradient(unsigned long key, unsigned long ix,
+                  rlhk_gen_i32 *gx, rlhk_gen_i32 *gy)
+{
+    static const signed char dx[] = {1, -1, 1, -1, 1, -1, 0, 0};
+    static const signed char dy[] = {1, 1, -1, -1, 0, 0, 1, -1};
+    unsigned long h = (key + ix * 0x9e3779b9UL) & 0xffffffffUL;
+    h ^= h >> 16;
+    h = h * 0x85ebca6bUL & 0xffffffffUL;
+    h ^= h >> 13;
+    h = h * 0xc2b2ae35UL & 0xffffffffUL;
+    h ^= h >> 16;
+    *gx = dx[h >> 29];
+    *gy = dy[h >> 29];
+}
+
+RLHK_GEN_API
+void
+rlhk_gen_noise(short *grid, int width, int height, long x0, long y0,
+               int shift, int octaves, unsigned long seed)
+{
+    rlhk_gen_i32 one = RLHK_GEN_NOISE_ONE;
+    int x, y, o;
+
+    for (y = 0; y < height; y++) {
+        short *row = grid + (long)y * width;
+        /* Coordinates wrap at 32 bits on every platform. */
+        unsigned long uy = ((unsigned long)y0 + y) & 0xffffffffUL;
+        for (x = 0; x < width; x++)
+            row[x] = 0;
+
+        for (o = 0; o < octaves && o < shift; o++) {
+            int s = shift - o;
+            unsigned long mask = (1UL << s) - 1;
+            unsigned long iy = uy >> s;
+            unsigned long iy1 = (iy + 1) & (0xffffffffUL >> s);
+            rlhk_gen_i32 fy = (rlhk_gen_i32)(uy & mask) << (12 - s);
+            rlhk_gen_i32 v = rlhk_gen_fade(fy);
+            unsigned long key0 = rlhk_rand_at(seed, o, (long)iy, 0);
+            unsigned long key1 = rlhk_rand_at(seed, o, (long)iy1, 0);
+            unsigned long ux = (unsigned long)x0 & 0xffffffffUL;
+            rlhk_gen_i32 g10x, g10y, g11x, g11y;
+            rlhk_gen_gradient(key0, ux >> s, &g10x, &g10y);
+            rlhk_gen_gradient(key1, ux >> s, &g11x, &g11y);
+
+            for (x = 0; x < width;) {
+                unsigned long ix1;
+                int f, run, j;
+                rlhk_gen_i32 g00x = g10x, g00y = g10y;
+                rlhk_gen_i32 g01x = g11x, g01y = g11y;
+                ux = ((unsigned long)x0 + x) & 0xffffffffUL;
+                ix1 = ((ux >> s) + 1) & (0xffffffffUL >> s);
+                f = (int)(ux & mask);
+                run = (int)mask + 1 - f;
+                if (run > width - x)
+                    run = width - x;
+                /* The left corners are the previous cell's right. */
+                rlhk_gen_gradient(key0, ix1, &g10x, &g10y);
+                rlhk_gen_gradient(key1, ix1, &g11x, &g11y);
+
+                /* The corner gradients are fixed across this cell. */
+                for (j = 0; j < run; j++) {
+                    rlhk_gen_i32 fx = (rlhk_gen_i32)(f + j) << (12 - s);
+                    rlhk_gen_i32 u = rlhk_gen_fade(fx);
+                    rlhk_gen_i32 n00 = g00x * fx + g00y * fy;
+                    rlhk_gen_i32 n10 = g10x * (fx - one) + g10y * fy;
+                    rlhk_gen_i32 n01 = g01x * fx + g01y * (fy - one);
+                    rlhk_gen_i32 n11 = g11x * (fx - one) + g11y * (fy - one);
+                    rlhk_gen_i32 a = n00 + RLHK_GEN_SHR((n10 - n00) * u, 12);
+                    rlhk_gen_i32 b = n01 + RLHK_GEN_SHR((n11 - n01) * u, 12);
+                    rlhk_gen_i32 n = a + RLHK_GEN_SHR((b - a) * v, 12);
+                    row[x + j] = (short)(row[x + j] + RLHK_GEN_SHR(n, o));
+                }
+                x += run;
+            }
+        }
+    }
+}
+
+struct rlhk_gen_poisson {
+    const unsigned long *map;
+    int width;
+    int height;
+    int radius;
+    int cell;
+    int reach;
+    int gw;
+    int gh;
+    long *grid;
+    long *active;
+    long nactive;
+    short *points;
+    long npoints;
+};
+
+/* Add (x, y) if it's open and no point is within the radius. */
+static int
+rlhk_gen_poisson_try(struct rlhk_gen_poisson *p, int x, int y)
+{
+    int gx, gy, i, j;
+    long r2 = (long)p->radius * p->radius;
+    if (x < 0 || y < 0 || x >= p->width || y >= p->height)
+        return 0;
+    if (RLHK_GEN_GET(p->map, p->width, x, y))
+        return 0;
+    gx = x / p->cell;
+    gy = y / p->cell;
+    for (j = gy - p->reach; j <= gy + p->reach; j++) {
+        if (j < 0 || j >= p->gh)
+            continue;
+        for (i = gx - p->reach; i <= gx + p->reach; i++) {
+            long k;
+            long dx, dy;
+            if (i < 0 || i >= p->gw)
+                continue;
+            k = p->grid[(long)j * p->gw + i];
+            if (k < 0)
+                continue;
+            dx = p->points[k * 2 + 0] - x;
+            dy = p->points[k * 2 + 1] - y;
+            if (dx * dx + dy * dy < r2)
+                return 0;
+        }
+    }
+    p->grid[(long)gy * p->gw + gx] = p->npoints;
+    p->active[p->nactive++] = p->npoints;
+    p->points[p->npoints * 2 + 0] = (short)x;
+    p->points[p->npoints * 2 + 1] = (short)y;
+    p->npoints++;
+    return 1;
+}
+
+/* Is any tile of the w by h rectangle at (x0, y0) open? */
+static int
+rlhk_gen_poisson_open(const struct rlhk_gen_poisson *p,
+                      int x0, int y0, int w, int h)
+{
+    int x, y;
+    for (y = y0; y < y0 + h; y++)
+        for (x = x0; x < x0 + w; x++)
+            if (!RLHK_GEN_GET(p->map, p->width, x, y))
+                return 1;
+    return 0;
+}
+
+/* Grow from the active points until none can place a neighbor. */
+static void
+rlhk_gen_poisson_grow(struct rlhk_gen_poisson *p, int tries,
+                      unsigned long *rng, long max)
+{
+    long r = p->radius;
+    while (p->nactive && p->npoints < max) {
+        long a = (long)rlhk_rand_range(rng, (unsigned long)p->nactive);
+        long k = p->active[a];
+        int x = p->points[k * 2 + 0];
+        int y = p->points[k * 2 + 1];
+        int t;
+        for (t = 0; t < tries; t++) {
+            /* Uniform over the annulus by rejection from its square. */
+            long dx = rlhk_rand_between(rng, 1 - 2 * r, 2 * r - 1);
+            long dy = rlhk_rand_between(rng, 1 - 2 * r, 2 * r - 1);
+            long d2 = dx * dx + dy * dy;
+            if (d2 < r * r || d2 >= 4 * r * r)
+                continue;
+            if (rlhk_gen_poisson_try(p, x + (int)dx, y + (int)dy))
+                break;
+        }
+        if (t == tries)
+            p->active[a] = p->active[--p->nactive];
+    }
+}
+
+RLHK_GEN_API
+long
+rlhk_gen_poisson(const unsigned long *map, int width, int height,
+                 int radius, int tries, unsigned long *rng,
+                 short *points, long max, void *buf, long buflen)
+{
+    struct rlhk_gen_poisson p;
+    long i, ncells;
+    int gx, gy;
+
+    if (radius < 1)
+        radius = 1;
+    if (buflen < RLHK_GEN_POISSON_BUFLEN(width, height, radius))
+        return -1;
+    p.map = map;
+    p.width = width;
+    p.height = height;
+    p.radius = radius;
+    p.cell = RLHK_GEN_POISSON_CELL(radius);
+    p.reach = (radius + p.cell - 2) / p.cell;
+    p.gw = (width + p.cell - 1) / p.cell;
+    p.gh = (height + p.cell - 1) / p.cell;
+    ncells = (long)p.gw * p.gh;
+    p.grid = buf;
+    p.active = p.grid + ncells;
+    p.nactive = 0;
+    p.points = points;
+    p.npoints = 0;
+    for (i = 0; i < ncells; i++)
+        p.grid[i] = -1;
+
+    /* Seed each empty cell in turn, and grow from whatever lands. */
+    for (gy = 0; gy < p.gh; gy++) {
+        for (gx = 0; gx < p.gw; gx++) {
+            int t;
+            int x0 = gx * p.cell;
+            int y0 = gy * p.cell;
+            int w = width - x0 < p.cell ? width - x0 : p.cell;
+            int h = height - y0 < p.cell ? height - y0 : p.cell;
+            if (p.grid[(long)gy * p.gw + gx] >= 0 ||
+                !rlhk_gen_poisson_open(&p, x0, y0, w, h))
+                continue;
+            for (t = 0; t < tries && p.npoints < max; t++) {
+                int x = x0 + (int)rlhk_rand_range(rng, w);
+                int y = y0 + (int)rlhk_rand_range(rng, h);
+                if (rlhk_gen_poisson_try(&p, x, y)) {
+                    rlhk_gen_poisson_grow(&p, tries, rng, max);
+                    break;
+                }
+            }
+        }
+    }
+    return p.npoints;
+}
+
+#endif /* RLHK_GEN_IMPLEMENTATION */
+#endif /* RLHK_GEN_H */
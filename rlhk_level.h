@@ -0,0 +1,441 @@
+/* Roguelike Header Kit : Level Images
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Provides a versioned, flat binary format for prebuilt levels that
+ * can be memory-mapped read-only and used in place as the backing
+ * store for passability and transparency, e.g. directly from within
+ * rlhk_algo_map_call(). Opening a level is O(1) regardless of its
+ * size, nothing is parsed or copied, and any number of processes
+ * mapping the same file share a single copy in the page cache.
+ *
+ * A level image is laid out as follows. All header fields are 32-bit
+ * little endian integers, so images are portable between hosts.
+ *
+ *     offset  size  field
+ *          0     8  magic "RLHKLVL\n"
+ *          8     4  format version (currently 1)
+ *         12     4  header size in bytes
+ *         16     4  width in tiles
+ *         20     4  height in tiles
+ *         24     4  row stride in bytes, a multiple of 8
+ *         28     4  offset of the passable bitmap
+ *         32     4  offset of the transparent bitmap
+ *         36     4  total image size in bytes
+ *
+ * Each bitmap is "height" rows of "stride" bytes. Tile (x, y) is bit
+ * (x % 8) of byte (y * stride + x / 8), least significant bit first.
+ * A set bit means passable or transparent respectively. Readers
+ * accept any header size at least as large as the version 1 header,
+ * so future versions may append fields without breaking old readers.
+ *
+ * Memory mapping is available on POSIX and Win32. Elsewhere, read
+ * the file into a buffer yourself and use rlhk_level_load().
+ *
+ * Functions:
+ *   - rlhk_level_size
+ *   - rlhk_level_format
+ *   - rlhk_level_set
+ *   - rlhk_level_save
+ *   - rlhk_level_load
+ *   - rlhk_level_open
+ *   - rlhk_level_close
+ *   - rlhk_level_passable
+ *   - rlhk_level_transparent
+ */
+#ifndef RLHK_LEVEL_H
+#define RLHK_LEVEL_H
+
+#ifndef RLHK_LEVEL_API
+#  ifdef RLHK_API
+#    define RLHK_LEVEL_API RLHK_API
+#  else
+#    define RLHK_LEVEL_API
+#  endif
+#endif
+
+#define RLHK_LEVEL_VERSION 1
+
+enum rlhk_level_layer {
+    RLHK_LEVEL_PASSABLE,
+    RLHK_LEVEL_TRANSPARENT
+};
+
+/**
+ * A loaded (read-only) level. Treat the fields as read-only too.
+ */
+struct rlhk_level {
+    const unsigned char *passable;
+    const unsigned char *transparent;
+    long width;
+    long height;
+    long stride;
+    void *mapping;
+    long mapsize;
+};
+
+/**
+ * Returns the size in bytes of a level image of the given dimensions,
+ * or 0 if the dimensions are invalid.
+ */
+RLHK_LEVEL_API
+long rlhk_level_size(long width, long height);
+
+/**
+ * Write an empty level image (all walls, all opaque) into a buffer.
+ *
+ * Returns 1 on success or 0 if buflen is smaller than
+ * rlhk_level_size().
+ */
+RLHK_LEVEL_API
+int rlhk_level_format(void *buf, long buflen, long width, long height);
+
+/**
+ * Set or clear a tile's bit in one layer of a writable level image
+ * created by rlhk_level_format(). Out of bounds tiles are ignored.
+ */
+RLHK_LEVEL_API
+void rlhk_level_set(void *buf, enum rlhk_level_layer layer,
+                    int x, int y, int value);
+
+/**
+ * Write a level image to a file, replacing any existing file.
+ *
+ * Returns 1 on success, 0 on failure.
+ */
+RLHK_LEVEL_API
+int rlhk_level_save(const char *path, const void *buf);
+
+/**
+ * Validate a level image in memory and prepare a level handle that
+ * refers to it. The image must remain valid while the level is used.
+ *
+ * Returns 1 on success or 0 if the image is not a valid level.
+ */
+RLHK_LEVEL_API
+int rlhk_level_load(struct rlhk_level *level, const void *buf, long len);
+
+/**
+ * Memory-map a level file read-only and prepare a level handle.
+ *
+ * Call rlhk_level_close() when done with the level.
+ *
+ * Returns 1 on success, 0 on failure.
+ */
+RLHK_LEVEL_API
+int rlhk_level_open(struct rlhk_level *level, const char *path);
+
+/**
+ * Release a level opened with rlhk_level_open(). Does nothing for
+ * levels prepared with rlhk_level_load().
+ */
+RLHK_LEVEL_API
+void rlhk_level_close(struct rlhk_level *level);
+
+/**
+ * Returns non-zero if the tile at (x, y) is passable, or 0 if it's
+ * impassable or out of bounds.
+ */
+RLHK_LEVEL_API
+int rlhk_level_passable(const struct rlhk_level *level, int x, int y);
+
+/**
+ * Returns non-zero if the tile at (x, y) is transparent, or 0 if it's
+ * opaque or out of bounds.
+ */
+RLHK_LEVEL_API
+int rlhk_level_transparent(const struct rlhk_level *level, int x, int y);
+
+/* Implementation */
+#if defined(RLHK_IMPLEMENTATION) || defined(RLHK_LEVEL_IMPLEMENTATION)
+#include <string.h>
+
+#define RLHK_LEVEL_HEADER 40
+
+static unsigned long
+rlhk_level_get32(const unsigned char *p)
+{
+    return (unsigned long)p[0] <<  0 |
+           (unsigned long)p[1] <<  8 |
+           (unsigned long)p[2] << 16 |
+           (unsigned long)p[3] << 24;
+}
+
+static void
+rlhk_level_put32(unsigned char *p, unsigned long v)
+{
+    p[0] = v >>  0;
+    p[1] = v >>  8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static long
+rlhk_level_stride(long width)
+{
+    return (width + 63) / 64 * 8;
+}
+
+RLHK_LEVEL_API
+long
+rlhk_level_size(long width, long height)
+{
+    long stride = rlhk_level_stride(width);
+    if (width < 1 || height < 1 || width > 0x7fff || height > 0x7fff)
+        return 0;
+    return RLHK_LEVEL_HEADER + 2 * stride * height;
+}
+
+RLHK_LEVEL_API
+int
+rlhk_level_format(void *buf, long buflen, long width, long height)
+{
+    unsigned char *p = buf;
+    long size = rlhk_level_size(width, height);
+    long stride = rlhk_level_stride(width);
+    if (!size || buflen < size)
+        return 0;
+    memset(p, 0, size);
+    memcpy(p, "RLHKLVL\n", 8);
+    rlhk_level_put32(p +  8, RLHK_LEVEL_VERSION);
+    rlhk_level_put32(p + 12, RLHK_LEVEL_HEADER);
+    rlhk_level_put32(p + 16, width);
+    rlhk_level_put32(p + 20, height);
+    rlhk_level_put32(p + 24, stride);
+    rlhk_level_put32(p + 28, RLHK_LEVEL_HEADER);
+    rlhk_level_put32(p + 32, RLHK_LEVEL_HEADER + stride * height);
+    rlhk_level_put32(p + 36, size);
+    return 1;
+}
+
+RLHK_LEVEL_API
+void
+rlhk_level_set(void *buf, enum rlhk_level_layer layer,
+               int x, int y, int value)
+{
+    unsigned char *p = buf;
+    long width = rlhk_level_get32(p + 16);
+    long height = rlhk_level_get32(p + 20);
+    long stride = rlhk_level_get32(p + 24);
+    long offset = rlhk_level_get32(p + (layer ? 32 : 28));
+    unsigned char *b;
+    if (x < 0 || y < 0 || x >= width || y >= height)
+        return;
+    b = p + offset + y * stride + x / 8;
+    if (value)
+        *b |= 1u << (x % 8);
+    else
+        *b &= ~(1u << (x % 8));
+}
+
+RLHK_LEVEL_API
+int
+rlhk_level_load(struct rlhk_level *level, const void *buf, long len)
+{
+    const unsigned char *p = buf;
+    unsigned long header, width, height, stride, passable, transparent;
+    unsigned long size, bitmap;
+
+    if (len < RLHK_LEVEL_HEADER || memcmp(p, "RLHKLVL\n", 8))
+        return 0;
+    if (rlhk_level_get32(p + 8) != RLHK_LEVEL_VERSION)
+        return 0;
+    header = rlhk_level_get32(p + 12);
+    width = rlhk_level_get32(p + 16);
+    height = rlhk_level_get32(p + 20);
+    stride = rlhk_level_get32(p + 24);
+    passable = rlhk_level_get32(p + 28);
+    transparent = rlhk_level_get32(p + 32);
+    size = rlhk_level_get32(p + 36);
+
+    /* Validate everything so that later lookups need no checks. */
+    if (header < RLHK_LEVEL_HEADER || size > (unsigned long)len)
+        return 0;
+    if (!width || !height || width > 0x7fff || height > 0x7fff)
+        return 0;
+    if (stride % 8 || stride * 8 < width || stride > 0x7fff)
+        return 0;
+    bitmap = stride * height;
+    if (passable < header || passable > size || size - passable < bitmap)
+        return 0;
+    if (transparent < header || transparent > size ||
+        size - transparent < bitmap)
+        return 0;
+
+    level->passable = p + passable;
+    level->transparent = p + transparent;
+    level->width = width;
+    level->height = height;
+    level->stride = stride;
+    level->mapping = 0;
+    level->mapsize = 0;
+    return 1;
+}
+
+RLHK_LEVEL_API
+int
+rlhk_level_passable(const struct rlhk_level *level, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= level->width || y >= level->height)
+        return 0;
+    return (level->passable[y * level->stride + x / 8] >> (x % 8)) & 1;
+}
+
+RLHK_LEVEL_API
+int
+rlhk_level_transparent(const struct rlhk_level *level, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= level->width || y >= level->height)
+        return 0;
+    return (level->transparent[y * level->stride + x / 8] >> (x % 8)) & 1;
+}
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__DJGPP__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+RLHK_LEVEL_API
+int
+rlhk_level_open(struct rlhk_level *level, const char *path)
+{
+    struct stat st;
+    void *p;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return 0;
+    if (fstat(fd, &st) == -1 || st.st_size > 0x7fffffffL) {
+        close(fd);
+        return 0;
+    }
+    p = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return 0;
+    if (!rlhk_level_load(level, p, st.st_size)) {
+        munmap(p, st.st_size);
+        return 0;
+    }
+    level->mapping = p;
+    level->mapsize = st.st_size;
+    return 1;
+}
+
+RLHK_LEVEL_API
+void
+rlhk_level_close(struct rlhk_level *level)
+{
+    if (level->mapping)
+        munmap(level->mapping, level->mapsize);
+    level->mapping = 0;
+}
+
+RLHK_LEVEL_API
+int
+rlhk_level_save(const char *path, const void *buf)
+{
+    const char *p = buf;
+    long size = rlhk_level_get32((const unsigned char *)buf + 36);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int success = 0;
+    if (fd != -1) {
+        while (size > 0) {
+            ssize_t r = write(fd, p, size);
+            if (r <= 0)
+                break;
+            p += r;
+            size -= r;
+        }
+        success = !size;
+        success &= close(fd) == 0;
+    }
+    return success;
+}
+
+#elif defined(_WIN32)
+#include <windows.h>
+
+RLHK_LEVEL_API
+int
+rlhk_level_open(struct rlhk_level *level, const char *path)
+{
+    DWORD size;
+    HANDLE m;
+    void *p = 0;
+    HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (f == INVALID_HANDLE_VALUE)
+        return 0;
+    size = GetFileSize(f, 0);
+    m = CreateFileMappingA(f, 0, PAGE_READONLY, 0, 0, 0);
+    CloseHandle(f);
+    if (!m)
+        return 0;
+    p = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(m);
+    if (!p)
+        return 0;
+    if (size > 0x7fffffffUL || !rlhk_level_load(level, p, size)) {
+        UnmapViewOfFile(p);
+        return 0;
+    }
+    level->mapping = p;
+    level->mapsize = size;
+    return 1;
+}
+
+RLHK_LEVEL_API
+void
+rlhk_level_close(struct rlhk_level *level)
+{
+    if (level->mapping)
+        UnmapViewOfFile(level->mapping);
+    level->mapping = 0;
+}
+
+RLHK_LEVEL_API
+int
+rlhk_level_save(const char *path, const void *buf)
+{
+    DWORD size = rlhk_level_get32((const unsigned char *)buf + 36);
+    DWORD written = 0;
+    int success;
+    HANDLE f = CreateFileA(path, GENERIC_WRITE, 0, 0, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL, 0);
+    if (f == INVALID_HANDLE_VALUE)
+        return 0;
+    success = WriteFile(f, buf, size, &written, 0) && written == size;
+    return CloseHandle(f) && success;
+}
+
+#else
+
+RLHK_LEVEL_API
+int
+rlhk_level_open(struct rlhk_level *level, const char *path)
+{
+    (void)level;
+    (void)path;
+    return 0; /* no memory mapping */
+}
+
+RLHK_LEVEL_API
+void
+rlhk_level_close(struct rlhk_level *level)
+{
+    level->mapping = 0;
+}
+
+RLHK_LEVEL_API
+int
+rlhk_level_save(const char *path, const void *buf)
+{
+    (void)path;
+    (void)buf;
+    return 0;
+}
+
+#endif
+#endif /* RLHK_LEVEL_IMPLEMENTATION */
+#endif /* RLHK_LEVEL_H */
@@ -0,0 +1,263 @@
+/* Roguelike Header Kit : Lighting
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Provides an incrementally-updated light map for many colored light
+ * sources, such as torches and spells. Each source caches the set of
+ * tiles it lights, as computed by rlhk_algo_fov_set(), and the light
+ * map holds the sum of every source's contribution. A source's field
+ * of view is only recomputed when it moves or when the opacity of a
+ * tile within its reach changes, and the light map is then updated
+ * by subtracting the old contribution and adding the new one. A frame
+ * in which only the player's light moves costs a single field of view
+ * no matter how many static lights there are.
+ *
+ * Light is integral, so subtracting a contribution restores the map
+ * exactly. Each source has RLHK_LIGHT_CHANNELS color channels (3 by
+ * default, e.g. red, green, blue) whose intensity falls off with the
+ * square of the distance, reaching 0 just past the source's radius.
+ * The light map stores the channels of each tile together, in
+ * row-major order: channel c of tile (x, y) is at
+ *
+ *     light[((long)y * width + x) * RLHK_LIGHT_CHANNELS + c]
+ *
+ * Sources and the light map are caller-owned. This header uses
+ * rlhk_algo.h, so you must also typedef rlhk_algo_map and implement
+ * RLHK_ALGO_MAP_GET_TRANSPARENT in rlhk_algo_map_call().
+ *
+ * Functions:
+ *   - rlhk_light_map_init
+ *   - rlhk_light_init
+ *   - rlhk_light_move
+ *   - rlhk_light_remove
+ *   - rlhk_light_opacity
+ *   - rlhk_light_update
+ */
+#ifndef RLHK_LIGHT_H
+#define RLHK_LIGHT_H
+
+#ifndef RLHK_LIGHT_API
+#  ifdef RLHK_API
+#    define RLHK_LIGHT_API RLHK_API
+#  else
+#    define RLHK_LIGHT_API
+#  endif
+#endif
+
+#include "rlhk_algo.h"
+
+#ifndef RLHK_LIGHT_CHANNELS
+#  define RLHK_LIGHT_CHANNELS 3
+#endif
+
+/**
+ * The combined light of all sources. Treat the fields as read-only.
+ */
+struct rlhk_light_map {
+    int width;
+    int height;
+    rlhk_algo_i32 *light;
+};
+
+/**
+ * A light source.
+ *
+ * Set the color channels directly, before the source is first lit
+ * or between rlhk_light_remove() and rlhk_light_move(). Treat the
+ * other fields as private.
+ */
+struct rlhk_light {
+    int color[RLHK_LIGHT_CHANNELS];
+    int x;
+    int y;
+    int radius;
+    unsigned char *set;
+    int litx;
+    int lity;
+    int lit;
+    int dirty;
+};
+
+/**
+ * Prepare an unlit light map of width by height tiles.
+ *
+ * You must provide its memory (light), width * height *
+ * RLHK_LIGHT_CHANNELS values, which need not be initialized.
+ */
+RLHK_LIGHT_API
+void rlhk_light_map_init(struct rlhk_light_map *map, int width, int height,
+                         rlhk_algo_i32 *light);
+
+/**
+ * Prepare a light source at (x, y) with a fixed radius, to be lit by
+ * the next rlhk_light_update(). Its color starts out black.
+ *
+ * You must provide the memory for its cached field of view (set),
+ * RLHK_ALGO_FOV_SETLEN(radius) bytes, which need not be initialized.
+ */
+RLHK_LIGHT_API
+void rlhk_light_init(struct rlhk_light *light, int x, int y, int radius,
+                     unsigned char *set);
+
+/**
+ * Move a light source to (x, y) as of the next rlhk_light_update().
+ * This also relights a removed source.
+ */
+RLHK_LIGHT_API
+void rlhk_light_move(struct rlhk_light *light, int x, int y);
+
+/**
+ * Immediately take a light source's contribution out of the light
+ * map. It stays dark until it's moved again.
+ */
+RLHK_LIGHT_API
+void rlhk_light_remove(struct rlhk_light_map *map, struct rlhk_light *light);
+
+/**
+ * Note that the opacity of the tile at (x, y) has changed, so that
+ * the next rlhk_light_update() recomputes every source that reaches
+ * it.
+ *
+ * Returns the number of sources affected.
+ */
+RLHK_LIGHT_API
+long rlhk_light_opacity(struct rlhk_light *lights, long n, int x, int y);
+
+/**
+ * Bring the light map up to date with the n sources in lights. Only
+ * sources that are new, have moved, or were affected by an opacity
+ * change compute a new field of view.
+ *
+ * Returns the number of sources recomputed.
+ *
+ * Methods used:
+ *   RLHK_ALGO_MAP_GET_TRANSPARENT
+ */
+RLHK_LIGHT_API
+long rlhk_light_update(struct rlhk_light_map *map, rlhk_algo_map m,
+                       struct rlhk_light *lights, long n);
+
+/* Implementation */
+#if defined(RLHK_IMPLEMENTATION) || defined(RLHK_LIGHT_IMPLEMENTATION)
+#include <stdlib.h>
+
+RLHK_LIGHT_API
+void
+rlhk_light_map_init(struct rlhk_light_map *map, int width, int height,
+                    rlhk_algo_i32 *light)
+{
+    long i;
+    long n = (long)width * height * RLHK_LIGHT_CHANNELS;
+    map->width = width;
+    map->height = height;
+    map->light = light;
+    for (i = 0; i < n; i++)
+        light[i] = 0;
+}
+
+RLHK_LIGHT_API
+void
+rlhk_light_init(struct rlhk_light *light, int x, int y, int radius,
+                unsigned char *set)
+{
+    int c;
+    for (c = 0; c < RLHK_LIGHT_CHANNELS; c++)
+        light->color[c] = 0;
+    light->x = x;
+    light->y = y;
+    light->radius = radius;
+    light->set = set;
+    light->lit = 0;
+    light->dirty = 1;
+}
+
+RLHK_LIGHT_API
+void
+rlhk_light_move(struct rlhk_light *light, int x, int y)
+{
+    light->x = x;
+    light->y = y;
+    light->dirty = 1;
+}
+
+/* Add (sign 1) or subtract (sign -1) the cached contribution. */
+static void
+rlhk_light_apply(struct rlhk_light_map *map, const struct rlhk_light *light,
+                 int sign)
+{
+    int dx, dy;
+    int r = light->radius;
+    long r2 = (long)(r + 1) * (r + 1);
+    for (dy = -r - 1; dy <= r + 1; dy++) {
+        int y = light->lity + dy;
+        if (y < 0 || y >= map->height)
+            continue;
+        for (dx = -r - 1; dx <= r + 1; dx++) {
+            int c;
+            int x = light->litx + dx;
+            long d2 = (long)dx * dx + (long)dy * dy;
+            rlhk_algo_i32 *p;
+            if (x < 0 || x >= map->width || d2 >= r2)
+                continue;
+            if (!RLHK_ALGO_FOV_GET(light->set, r, dx, dy))
+                continue;
+            p = map->light + ((long)y * map->width + x) * RLHK_LIGHT_CHANNELS;
+            for (c = 0; c < RLHK_LIGHT_CHANNELS; c++)
+                p[c] += sign * (light->color[c] * (r2 - d2) / r2);
+        }
+    }
+}
+
+RLHK_LIGHT_API
+void
+rlhk_light_remove(struct rlhk_light_map *map, struct rlhk_light *light)
+{
+    if (light->lit)
+        rlhk_light_apply(map, light, -1);
+    light->lit = 0;
+    light->dirty = 0;
+}
+
+RLHK_LIGHT_API
+long
+rlhk_light_opacity(struct rlhk_light *lights, long n, int x, int y)
+{
+    long i;
+    long count = 0;
+    for (i = 0; i < n; i++) {
+        struct rlhk_light *l = lights + i;
+        int reach = l->radius + 1;
+        if (!l->lit || abs(x - l->litx) > reach || abs(y - l->lity) > reach)
+            continue;
+        l->dirty = 1;
+        count++;
+    }
+    return count;
+}
+
+RLHK_LIGHT_API
+long
+rlhk_light_update(struct rlhk_light_map *map, rlhk_algo_map m,
+                  struct rlhk_light *lights, long n)
+{
+    long i;
+    long count = 0;
+    for (i = 0; i < n; i++) {
+        struct rlhk_light *l = lights + i;
+        if (!l->dirty)
+            continue;
+        if (l->lit)
+            rlhk_light_apply(map, l, -1);
+        rlhk_algo_fov_set(m, l->x, l->y, l->radius, l->set);
+        l->litx = l->x;
+        l->lity = l->y;
+        l->lit = 1;
+        l->dirty = 0;
+        rlhk_light_apply(map, l, 1);
+        count++;
+    }
+    return count;
+}
+
+#endif /* RLHK_LIGHT_IMPLEMENTATION */
+#endif /* RLHK_LIGHT_H */
@@ -9,13 +9,38 @@
 #  endif
 #endif
 
+#include <limits.h>
+
+/* Smallest unsigned integer type holding 32 bits. */
+#if UINT_MAX >= 0xffffffffUL
+typedef unsigned rlhk_rand_u32;
+#else
+typedef unsigned long rlhk_rand_u32;
+#endif
+
+/* Number of interleaved generators used by the fill functions. */
+#ifndef RLHK_RAND_LANES
+#  define RLHK_RAND_LANES 8
+#endif
+
 /**
  * Fill a buffer with true entropy from the operating system.
  *
  * This shouldn't be used directly to generate numbers, but rather to
  * seed a PRNG.
  *
- * Returns 1 on success, 0 on failure (leaving buf untouched).
+ * On POSIX systems this prefers getrandom(), falling back to
+ * /dev/urandom, and is safe to call from any number of threads.
+ *
+ * Single-threaded programs that seed often may define RLHK_RAND_POOL
+ * as a byte count, e.g. 256, to serve small requests from a pool of
+ * that size refilled in bulk. Bytes are wiped from the pool as they're
+ * handed out. Each call still costs a getpid() system call, so that a
+ * forked child discards its copy, but that's cheaper than a read. The
+ * pool is shared without locking, so concurrent calls may be handed
+ * the same bytes.
+ *
+ * Returns 1 on success, 0 on failure.
  */
 RLHK_RAND_API
 int rlhk_rand_entropy(void *buf, unsigned len);
@@ -26,27 +51,275 @@ int rlhk_rand_entropy(void *buf, unsigned len);
 RLHK_RAND_API
 unsigned long rlhk_rand_32(unsigned long *);
 
+/**
+ * Generate a uniform double in [0, 1] from a 32-bit state.
+ */
+RLHK_RAND_API
+double rlhk_rand_uniform(unsigned long *);
+
+/**
+ * Generate a uniform integer in [0, n) from a 32-bit state, where n
+ * is from 1 to 0xffffffff.
+ *
+ * Unlike rlhk_rand_32() % n this is unbiased, and it needs no
+ * division except on a rare rejection path.
+ */
+RLHK_RAND_API
+unsigned long rlhk_rand_range(unsigned long *, unsigned long n);
+
+/**
+ * Generate a uniform integer in [lo, hi] from a 32-bit state. The
+ * span hi - lo must fit in 32 bits.
+ */
+RLHK_RAND_API
+long rlhk_rand_between(unsigned long *, long lo, long hi);
+
+/**
+ * Generate a pair of independent standard normal doubles from a
+ * 32-bit state.
+ *
+ * This uses a table-driven Ziggurat: about 99% of samples cost one
+ * rlhk_rand_32() call, a table lookup and a multiply, and only the
+ * rare wedge and tail cases call into libm.
+ */
+RLHK_RAND_API
+void rlhk_rand_norm(unsigned long *, double *, double *);
+
+/**
+ * Seed a 128-bit xoshiro128** state, four 32-bit words, from a 32-bit
+ * seed. Distinct seeds give distinct states.
+ */
+RLHK_RAND_API
+void rlhk_rand_xoshiro_seed(rlhk_rand_u32 *s, unsigned long seed);
+
+/**
+ * Generate a uniform 32-bit integer from a 128-bit xoshiro128** state.
+ *
+ * This has a period of 2^128 - 1 and better statistical quality than
+ * rlhk_rand_32(), at a similar cost.
+ */
+RLHK_RAND_API
+unsigned long rlhk_rand_xoshiro(rlhk_rand_u32 *s);
+
+/**
+ * Advance a xoshiro128** state by 2^64 steps in constant time.
+ *
+ * Seed once, then copy the state and jump once per parallel stream:
+ * streams started this way never overlap for 2^64 outputs each.
+ */
+RLHK_RAND_API
+void rlhk_rand_xoshiro_jump(rlhk_rand_u32 *s);
+
+/**
+ * Advance a xoshiro128** state by 2^96 steps in constant time, for
+ * up to 2^32 groups of rlhk_rand_xoshiro_jump() streams.
+ */
+RLHK_RAND_API
+void rlhk_rand_xoshiro_long_jump(rlhk_rand_u32 *s);
+
+/**
+ * Generate a uniform 32-bit integer for tile (x, y) without state, by
+ * hashing the coordinates with a seed and a salt. The same arguments
+ * always give the same value, so tiles can be generated lazily, in
+ * any order, or in parallel. Use a different salt for each purpose
+ * (terrain, loot, etc.) so they don't correlate.
+ */
+RLHK_RAND_API
+unsigned long rlhk_rand_at(unsigned long seed, long x, long y,
+                           unsigned long salt);
+
+/**
+ * Fill out with rlhk_rand_at() for the n tiles of row y starting at
+ * column x, i.e. out[i] = rlhk_rand_at(seed, x + i, y, salt). The row
+ * is hashed once and the loop vectorizes.
+ */
+RLHK_RAND_API
+void rlhk_rand_at_row(unsigned long seed, long x, long y,
+                      unsigned long salt, rlhk_rand_u32 *out, long n);
+
+/**
+ * Seed RLHK_RAND_LANES independent 32-bit states for the fill
+ * functions from a single 32-bit state.
+ *
+ * Don't seed the lanes with successive outputs of rlhk_rand_32()
+ * directly: each would be the next one's sequence, one step behind.
+ */
+RLHK_RAND_API
+void rlhk_rand_fill_seed(unsigned long *, rlhk_rand_u32 *lanes);
+
+/**
+ * Fill out with n uniform 32-bit integers from RLHK_RAND_LANES
+ * independent 32-bit states, interleaving their outputs.
+ *
+ * The lanes have no dependencies between them, so the compiler can
+ * vectorize the loop and generate several values per instruction.
+ */
+RLHK_RAND_API
+void rlhk_rand_fill_u32(rlhk_rand_u32 *lanes, rlhk_rand_u32 *out, long n);
+
+/**
+ * Fill out with n uniform doubles in [0, 1], like rlhk_rand_uniform(),
+ * from RLHK_RAND_LANES states as rlhk_rand_fill_u32().
+ */
+RLHK_RAND_API
+void rlhk_rand_fill_uniform(rlhk_rand_u32 *lanes, double *out, long n);
+
+/**
+ * Fill out with n standard normal doubles, like rlhk_rand_norm(),
+ * from RLHK_RAND_LANES states as rlhk_rand_fill_u32().
+ */
+RLHK_RAND_API
+void rlhk_rand_fill_norm(rlhk_rand_u32 *lanes, double *out, long n);
+
+/**
+ * A table for drawing from a discrete distribution (loot, spawns,
+ * etc.) in constant time, using Vose's alias method. Treat the fields
+ * as private.
+ */
+struct rlhk_rand_alias {
+    long n;
+    double *scaled;
+    long *work;
+    long *alias;
+    rlhk_rand_u32 *prob;
+};
+
+/**
+ * Always-sufficient alias table buffer size, in bytes, for n entries.
+ */
+#define RLHK_RAND_ALIAS_BUFLEN(n) \
+    ((long)((n) * (sizeof(double) + 2 * sizeof(long) + \
+                   sizeof(rlhk_rand_u32))))
+
+/**
+ * Prepare an alias table for n entries, which must then be built
+ * with rlhk_rand_alias_build() before drawing.
+ *
+ * You must provide the table's memory (buf) and its size in bytes
+ * (buflen), suitably aligned for a double.
+ *
+ * Returns 1 on success or 0 if the buffer is too small.
+ */
+RLHK_RAND_API
+int rlhk_rand_alias_init(struct rlhk_rand_alias *, long n,
+                         void *buf, long buflen);
+
+/**
+ * Build or rebuild the table from n non-negative weights, in O(n) and
+ * without allocation. Entry i is drawn with probability proportional
+ * to weights[i].
+ *
+ * Returns 1 on success or 0 if the weights are negative or all zero.
+ */
+RLHK_RAND_API
+int rlhk_rand_alias_build(struct rlhk_rand_alias *, const double *weights);
+
+/**
+ * Draw an entry index from a built table using a 32-bit state.
+ */
+RLHK_RAND_API
+long rlhk_rand_alias_draw(const struct rlhk_rand_alias *, unsigned long *);
+
 /* Implementation */
 #if defined(RLHK_IMPLEMENTATION) || defined(RLHK_RAND_IMPLEMENTATION)
 #include <math.h>
 
 /* System entropy. */
 #if (defined(__unix__) || defined(__APPLE__)) && !defined(__DJGPP__)
+#include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
 
+#ifndef RLHK_RAND_GETRANDOM
+#  if defined(__linux__) && defined(__GLIBC__) && \
+      (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 25))
+#    define RLHK_RAND_GETRANDOM 1
+#  else
+#    define RLHK_RAND_GETRANDOM 0
+#  endif
+#endif
+#if RLHK_RAND_GETRANDOM
+#include <sys/random.h>
+#endif
+
+/* Entropy pool size in bytes, or 0 to go to the system every call. */
+#ifndef RLHK_RAND_POOL
+#  define RLHK_RAND_POOL 0
+#endif
+
+/* Read from the system: getrandom() if available, else /dev/urandom,
+ * which also covers kernels too old for getrandom().
+ */
+static int
+rlhk_rand_system(void *buf, unsigned len)
+{
+    unsigned char *p = buf;
+    int fd;
+#if RLHK_RAND_GETRANDOM
+    while (len) {
+        long r = getrandom(p, len, 0);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            break;
+        p += r;
+        len -= r;
+    }
+    if (!len)
+        return 1;
+#endif
+    fd = open("/dev/urandom", O_RDONLY);
+    if (fd == -1)
+        return 0;
+    while (len) {
+        long r = read(fd, p, len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        p += r;
+        len -= r;
+    }
+    close(fd);
+    return !len;
+}
+
+#if RLHK_RAND_POOL
 RLHK_RAND_API
 int
 rlhk_rand_entropy(void *buf, unsigned len)
 {
-    int fd = open("/dev/urandom", O_RDONLY);
-    int success = 0;
-    if (fd != -1) {
-        success = read(fd, buf, len) == len;
-        close(fd);
+    static unsigned char pool[RLHK_RAND_POOL];
+    static unsigned avail;
+    static pid_t owner;
+    pid_t pid = getpid();
+
+    if (len > sizeof(pool))
+        return rlhk_rand_system(buf, len);
+    /* A forked child must never hand out its parent's bytes. */
+    if (pid != owner) {
+        avail = 0;
+        owner = pid;
     }
-    return success;
+    if (avail < len) {
+        if (!rlhk_rand_system(pool, sizeof(pool)))
+            return 0;
+        avail = sizeof(pool);
+    }
+    avail -= len;
+    memcpy(buf, pool + avail, len);
+    memset(pool + avail, 0, len);
+    return 1;
+}
+#else
+RLHK_RAND_API
+int
+rlhk_rand_entropy(void *buf, unsigned len)
+{
+    return rlhk_rand_system(buf, len);
 }
+#endif /* RLHK_RAND_POOL */
 
 #elif defined(_WIN32)
 #include <windows.h>
@@ -105,19 +378,528 @@ rlhk_rand_uniform(unsigned long *s)
     return rlhk_rand_32(s) / (double)0xffffffffUL;
 }
 
+/* The full 64-bit product of two 32-bit values, returning the high
+ * half and storing the low half in *lo.
+ */
+static unsigned long
+rlhk_rand_mul32(unsigned long a, unsigned long b, unsigned long *lo)
+{
+#if ULONG_MAX > 0xffffffffUL
+    unsigned long m = a * b;
+    *lo = m & 0xffffffffUL;
+    return m >> 32;
+#else
+    unsigned long al = a & 0xffff, ah = a >> 16;
+    unsigned long bl = b & 0xffff, bh = b >> 16;
+    unsigned long ll = al * bl;
+    unsigned long lh = al * bh;
+    unsigned long hl = ah * bl;
+    unsigned long mid = (ll >> 16) + (lh & 0xffff) + (hl & 0xffff);
+    *lo = (mid << 16 | (ll & 0xffff)) & 0xffffffffUL;
+    return ah * bh + (lh >> 16) + (hl >> 16) + (mid >> 16);
+#endif
+}
+
+/* Lemire's multiply-shift: the high half of x * n is uniform over
+ * [0, n) once the few x whose low half falls below 2^32 % n are
+ * rejected, and that remainder is only computed when the low half is
+ * already below n.
+ */
+RLHK_RAND_API
+unsigned long
+rlhk_rand_range(unsigned long *s, unsigned long n)
+{
+    unsigned long lo;
+    unsigned long hi = rlhk_rand_mul32(rlhk_rand_32(s), n, &lo);
+    if (lo < n) {
+        unsigned long t = (0xffffffffUL - n + 1) % n;
+        while (lo < t)
+            hi = rlhk_rand_mul32(rlhk_rand_32(s), n, &lo);
+    }
+    return hi;
+}
+
+RLHK_RAND_API
+long
+rlhk_rand_between(unsigned long *s, long lo, long hi)
+{
+    unsigned long span = ((unsigned long)hi - lo) & 0xffffffffUL;
+    unsigned long r;
+    if (span == 0xffffffffUL)
+        r = rlhk_rand_32(s);
+    else
+        r = rlhk_rand_range(s, span + 1);
+    return (long)((unsigned long)lo + r);
+}
+
+/* Ziggurat tables (Marsaglia & Tsang) for 128 layers and 24-bit
+ * magnitudes. A magnitude below k[i] lies wholly inside layer i, w[i]
+ * scales a magnitude to a sample, and f[i] is the density at the
+ * outer edge of layer i. Layer 0 is the base strip, including the
+ * tail beyond RLHK_RAND_ZIG_R. Generated offline by their zigset(),
+ * scaled to 2^24.
+ */
+#define RLHK_RAND_ZIG_R 3.442619855899
+
+static const unsigned long rlhk_rand_zig_k[128] = {
+    0xed5a44UL, 0x000000UL, 0xc01e36UL, 0xd9c88fUL, 0xe4b68dUL, 0xeac00aUL,
+    0xee9243UL, 0xf1344bUL, 0xf3208bUL, 0xf4979cUL, 0xf5bec5UL, 0xf6ad05UL,
+    0xf77151UL, 0xf815ceUL, 0xf8a199UL, 0xf919d8UL, 0xf98259UL, 0xf9ddfdUL,
+    0xfa2efcUL, 0xfa7711UL, 0xfab79cUL, 0xfaf1baUL, 0xfb2651UL, 0xfb561cUL,
+    0xfb81baUL, 0xfba9adUL, 0xfbce63UL, 0xfbf039UL, 0xfc0f81UL, 0xfc2c7dUL,
+    0xfc476bUL, 0xfc607bUL, 0xfc77ddUL, 0xfc8db6UL, 0xfca22aUL, 0xfcb557UL,
+    0xfcc757UL, 0xfcd844UL, 0xfce832UL, 0xfcf734UL, 0xfd055bUL, 0xfd12b8UL,
+    0xfd1f58UL, 0xfd2b47UL, 0xfd3692UL, 0xfd4141UL, 0xfd4b60UL, 0xfd54f5UL,
+    0xfd5e09UL, 0xfd66a4UL, 0xfd6ecbUL, 0xfd7684UL, 0xfd7dd5UL, 0xfd84c4UL,
+    0xfd8b53UL, 0xfd9188UL, 0xfd9766UL, 0xfd9cf1UL, 0xfda22cUL, 0xfda71aUL,
+    0xfdabbeUL, 0xfdb019UL, 0xfdb42eUL, 0xfdb800UL, 0xfdbb8fUL, 0xfdbeddUL,
+    0xfdc1ecUL, 0xfdc4bdUL, 0xfdc751UL, 0xfdc9a8UL, 0xfdcbc4UL, 0xfdcda5UL,
+    0xfdcf4cUL, 0xfdd0b8UL, 0xfdd1e9UL, 0xfdd2e0UL, 0xfdd39cUL, 0xfdd41dUL,
+    0xfdd462UL, 0xfdd46aUL, 0xfdd435UL, 0xfdd3c0UL, 0xfdd30cUL, 0xfdd215UL,
+    0xfdd0daUL, 0xfdcf58UL, 0xfdcd8eUL, 0xfdcb79UL, 0xfdc914UL, 0xfdc65dUL,
+    0xfdc350UL, 0xfdbfe8UL, 0xfdbc1fUL, 0xfdb7f1UL, 0xfdb357UL, 0xfdae49UL,
+    0xfda8bfUL, 0xfda2b0UL, 0xfd9c12UL, 0xfd94d9UL, 0xfd8cf7UL, 0xfd845dUL,
+    0xfd7afaUL, 0xfd70b8UL, 0xfd6580UL, 0xfd5938UL, 0xfd4bbeUL, 0xfd3cedUL,
+    0xfd2c98UL, 0xfd1a89UL, 0xfd0680UL, 0xfcf02eUL, 0xfcd732UL, 0xfcbb14UL,
+    0xfc9b3bUL, 0xfc76e6UL, 0xfc4d18UL, 0xfc1c7fUL, 0xfbe354UL, 0xfb9f18UL,
+    0xfb4c34UL, 0xfae541UL, 0xfa61c1UL, 0xf9b369UL, 0xf8c01eUL, 0xf75217UL,
+    0xf4e442UL, 0xefacc9UL
+};
+static const double rlhk_rand_zig_w[128] = {
+    2.2131718675747815e-07, 1.6231588412163536e-08, 2.1628822749676225e-08,
+    2.5424241206373186e-08, 2.8457512694399942e-08, 3.1033518240574632e-08,
+    3.3300648832809042e-08, 3.5343345550981064e-08, 3.7214672406676453e-08,
+    3.8950362130402043e-08, 4.057573787386147e-08, 4.2109466274704722e-08,
+    4.3565744795947602e-08, 4.4955650833490826e-08, 4.6288012736723418e-08,
+    4.7569993772748525e-08, 4.8807496231815654e-08, 5.0005448716734492e-08,
+    5.1168015193570448e-08, 5.2298750228460036e-08, 5.3400716339405637e-08,
+    5.4476574124278562e-08, 5.5528652466246535e-08, 5.6559003920036938e-08,
+    5.7569448912212246e-08, 5.8561611385073007e-08, 5.9536947816192126e-08,
+    6.0496771052559048e-08, 6.1442270044576858e-08, 6.2374526307823978e-08,
+    6.3294527750898854e-08, 6.4203180366331083e-08, 6.5101318175034366e-08,
+    6.5989711733700992e-08, 6.6869075452240839e-08, 6.7740073920080708e-08,
+    6.8603327402404989e-08, 6.9459416637703922e-08, 7.0308887044429073e-08,
+    7.1152252425737899e-08, 7.1989998246189932e-08, 7.2822584542035841e-08,
+    7.3650448516807715e-08, 7.4474006865803493e-08, 7.5293657866395775e-08,
+    7.6109783265599944e-08, 7.6922749991786268e-08, 7.7732911713636925e-08,
+    7.8540610266292934e-08, 7.9346176961995797e-08, 8.0149933800312696e-08,
+    8.0952194591173144e-08, 8.1753266002377426e-08, 8.2553448541918506e-08,
+    8.3353037484348137e-08, 8.4152323749486071e-08, 8.4951594740990406e-08,
+    8.5751135151658269e-08, 8.6551227741791282e-08, 8.7352154096526554e-08,
+    8.8154195367689381e-08, 8.8957633005461338e-08, 8.976274948496838e-08,
+    9.056982903277517e-08, 9.1379158358218867e-08, 9.2191027394527817e-08,
+    9.3005730054746207e-08, 9.3823565007627059e-08, 9.4644836478863723e-08,
+    9.5469855083309301e-08, 9.6298938694188652e-08, 9.7132413355745952e-08,
+    9.7970614246300969e-08, 9.8813886699320325e-08, 9.9662587290859277e-08,
+    1.0051708500261117e-07, 1.0137776247083645e-07, 1.0224501733265326e-07,
+    1.0311926368258777e-07, 1.0400093365393879e-07, 1.0489047914144954e-07,
+    1.0578837368405279e-07, 1.0669511452912442e-07, 1.0761122490282228e-07,
+    1.0853725651479516e-07, 1.09473792329934e-07, 1.1042144964504785e-07,
+    1.1138088351455263e-07, 1.1235279057668203e-07, 1.1333791334063715e-07,
+    1.1433704500582873e-07, 1.1535103489736455e-07, 1.1638079461774568e-07,
+    1.1742730503406087e-07, 1.1849162424371361e-07, 1.1957489669105244e-07,
+    1.2067836364372882e-07, 1.218033752831857e-07, 1.2295140472104004e-07,
+    1.2412406432581048e-07, 1.2532312483723393e-07, 1.2655053786480287e-07,
+    1.2780846252205344e-07, 1.2909929715090525e-07, 1.3042571735835368e-07,
+    1.3179072194568535e-07, 1.3319768879359838e-07, 1.346504434269189e-07,
+    1.3615334389671515e-07, 1.3771138690106648e-07, 1.3933034189577322e-07,
+    1.4101692260012857e-07, 1.4277900922364369e-07, 1.4462594065271317e-07,
+    1.4656890496086064e-07, 1.4862147105308605e-07, 1.5080032780103847e-07,
+    1.5312633668928968e-07, 1.5562607338618323e-07, 1.5833416052230356e-07,
+    1.6129693824778912e-07, 1.6457851960582595e-07, 1.6827138367586794e-07,
+    1.7251634639629894e-07, 1.7754413203285815e-07, 1.8377476085524966e-07,
+    1.9211083558685431e-07, 2.0519613360756637e-07
+};
+static const double rlhk_rand_zig_f[128] = {
+    1, 0.96359969312708615, 0.93628268168505957,
+    0.9130436479717402, 0.8922816507840261, 0.87324304891006954,
+    0.85550060786945059, 0.83878360529598961, 0.82290721138140899,
+    0.80773829468296054, 0.79317701177130506, 0.7791460859296877,
+    0.7655841738977045, 0.75244155917461142, 0.73967724367264731,
+    0.72725691834418482, 0.7151515074104986, 0.70333609901615812,
+    0.69178914343667508, 0.68049184099733406, 0.66942766734889037,
+    0.65858200005008805, 0.64794182111022247, 0.6374954773350423,
+    0.62723248524992725, 0.61714337081888093, 0.60721953662512029,
+    0.59745315094451668, 0.58783705443470657, 0.57836468111976314,
+    0.56902999106795094, 0.55982741270408687, 0.55075179311460454,
+    0.5417983550254255, 0.53296265938383613, 0.52424057267298407,
+    0.51562823824400184, 0.50712205107556896, 0.4987186354709795,
+    0.49041482528384411, 0.48220764632948521, 0.47409430069301695,
+    0.46607215268945612, 0.45813871626787206, 0.45029164368203922,
+    0.44252871527546844, 0.43484783024999091, 0.42724699830499607,
+    0.41972433204957438, 0.412278040102661, 0.40490642080722294,
+    0.39760785649387331, 0.39038080823731458, 0.3832238110559012,
+    0.37613546951056259, 0.36911445366447221, 0.36215949536931757,
+    0.35526938484791709, 0.34844296754632659, 0.34167914123155041,
+    0.33497685331358917, 0.3283350983728503, 0.32175291587598492,
+    0.31522938806501088, 0.30876363800618112, 0.30235482778648354,
+    0.29600215684693298, 0.28970486044295984, 0.28346220822323298,
+    0.27727350291918812, 0.27113807913838461, 0.26505530225558921,
+    0.25902456739620483, 0.25304529850732577, 0.24711694751232141,
+    0.24123899354543982, 0.23541094226347908, 0.22963232523211613,
+    0.22390269938500842, 0.2182216465543054, 0.2125887730717303,
+    0.20700370943992652, 0.20146611007431367, 0.19597565311627774,
+    0.19053204031913715, 0.18513499700899219, 0.17978427212329545,
+    0.1744796383307895, 0.169220892237365, 0.16400785468342038,
+    0.1588403711394793, 0.15371831220818166, 0.14864157424234226,
+    0.14361008009062776, 0.1386237799845946, 0.13368265258343937,
+    0.12878670619594321, 0.12393598020286782, 0.11913054670765083,
+    0.11437051244886601, 0.10965602101484027, 0.10498725540942132,
+    0.10036444102865587, 0.095787849121731439, 0.091257800826830257,
+    0.086774671894780178, 0.082338898242235656, 0.077950982513973394,
+    0.073611501884113403, 0.069321117393577908, 0.065080585213068073,
+    0.060890770348040406, 0.056752663481049848, 0.052667401903051012,
+    0.048636295859867805, 0.044660862200491425, 0.040742868074444175,
+    0.036884388786656203, 0.033087886146225751, 0.02935631744000685,
+    0.025693291935934271, 0.022103304615927098, 0.018592102737011288,
+    0.015167298010546568, 0.011839478657884862, 0.0086244844128598851,
+    0.0055489952207713449, 0.0026696290838809228
+};
+
+/* Uniform on the open interval (0, 1), safe for log(). */
+static double
+rlhk_rand_open(unsigned long *s)
+{
+    return (rlhk_rand_32(s) + 0.5) / 4294967296.0;
+}
+
+/* Turn a 32-bit draw into a normal sample, drawing more from the
+ * state only when r falls outside its layer's rectangle.
+ */
+static double
+rlhk_rand_zig(unsigned long *s, unsigned long r)
+{
+    for (;;) {
+        /* 24-bit magnitude, sign bit, 7-bit layer from a single draw. */
+        unsigned long u = r >> 8;
+        int sign = (int)(r >> 7 & 1);
+        int i = (int)(r & 0x7f);
+        double x = u * rlhk_rand_zig_w[i];
+        if (u < rlhk_rand_zig_k[i])
+            return sign ? -x : x;
+        if (i == 0) {
+            double y;
+            do {
+                x = -log(rlhk_rand_open(s)) / RLHK_RAND_ZIG_R;
+                y = -log(rlhk_rand_open(s));
+            } while (y + y < x * x);
+            x += RLHK_RAND_ZIG_R;
+            return sign ? -x : x;
+        }
+        if (rlhk_rand_zig_f[i] + rlhk_rand_uniform(s) *
+            (rlhk_rand_zig_f[i - 1] - rlhk_rand_zig_f[i]) < exp(-0.5 * x * x))
+            return sign ? -x : x;
+        r = rlhk_rand_32(s);
+    }
+}
+
 RLHK_RAND_API
 void
 rlhk_rand_norm(unsigned long *s, double *n0, double *n1)
 {
-    double x0, x1, w;
-    do {
-        x0 = 2 * rlhk_rand_uniform(s) - 1;
-        x1 = 2 * rlhk_rand_uniform(s) - 1;
-        w = x0 * x0 + x1 * x1;
-    } while (w >= 1);
-    w = sqrt((-2.0 * log(w)) / w);
-    *n0 = x0 * w;
-    *n1 = x1 * w;
+    *n0 = rlhk_rand_zig(s, rlhk_rand_32(s));
+    *n1 = rlhk_rand_zig(s, rlhk_rand_32(s));
+}
+
+/* MurmurHash3's fmix32: a bijection on 32-bit values fixing only 0. */
+static unsigned long
+rlhk_rand_mix32(unsigned long h)
+{
+    h ^= h >> 16;
+    h = h * 0x85ebca6bUL & 0xffffffffUL;
+    h ^= h >> 13;
+    h = h * 0xc2b2ae35UL & 0xffffffffUL;
+    h ^= h >> 16;
+    return h;
+}
+
+RLHK_RAND_API
+void
+rlhk_rand_xoshiro_seed(rlhk_rand_u32 *s, unsigned long seed)
+{
+    /* At most one word is 0, so the state is never all zeros. */
+    int i;
+    for (i = 0; i < 4; i++) {
+        seed = (seed + 0x9e3779b9UL) & 0xffffffffUL;
+        s[i] = (rlhk_rand_u32)rlhk_rand_mix32(seed);
+    }
+}
+
+/* Absorb the row into the hash; each column is then one more mix. */
+static unsigned long
+rlhk_rand_at_y(unsigned long seed, long y, unsigned long salt)
+{
+    unsigned long h = rlhk_rand_mix32(seed & 0xffffffffUL);
+    h = rlhk_rand_mix32((h + salt * 0x9e3779b9UL) & 0xffffffffUL);
+    return rlhk_rand_mix32((h + (unsigned long)y * 0x9e3779b9UL) &
+                           0xffffffffUL);
+}
+
+RLHK_RAND_API
+unsigned long
+rlhk_rand_at(unsigned long seed, long x, long y, unsigned long salt)
+{
+    unsigned long h = rlhk_rand_at_y(seed, y, salt);
+    return rlhk_rand_mix32((h + (unsigned long)x * 0x9e3779b9UL) &
+                           0xffffffffUL);
+}
+
+RLHK_RAND_API
+void
+rlhk_rand_at_row(unsigned long seed, long x, long y,
+                 unsigned long salt, rlhk_rand_u32 *out, long n)
+{
+    /* Stay in rlhk_rand_u32 so the loop vectorizes on 32-bit lanes. */
+    rlhk_rand_u32 m = (rlhk_rand_u32)0xffffffffUL;
+    rlhk_rand_u32 g = (rlhk_rand_u32)0x9e3779b9UL;
+    rlhk_rand_u32 c1 = (rlhk_rand_u32)0x85ebca6bUL;
+    rlhk_rand_u32 c2 = (rlhk_rand_u32)0xc2b2ae35UL;
+    rlhk_rand_u32 h = (rlhk_rand_u32)rlhk_rand_at_y(seed, y, salt);
+    long i;
+    h = (h + (rlhk_rand_u32)x * g) & m;
+    for (i = 0; i < n; i++) {
+        rlhk_rand_u32 v = (h + (rlhk_rand_u32)i * g) & m;
+        v ^= v >> 16;
+        v = v * c1 & m;
+        v ^= v >> 13;
+        v = v * c2 & m;
+        v ^= v >> 16;
+        out[i] = v;
+    }
+}
+
+#define RLHK_RAND_ROTL32(x, k) \
+    (((x) << (k) | (x) >> (32 - (k))) & 0xffffffffUL)
+
+RLHK_RAND_API
+unsigned long
+rlhk_rand_xoshiro(rlhk_rand_u32 *s)
+{
+    unsigned long s1 = s[1];
+    unsigned long r = RLHK_RAND_ROTL32(s1 * 5 & 0xffffffffUL, 7);
+    unsigned long t = s1 << 9 & 0xffffffffUL;
+    unsigned long s3;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s3 = s[3];
+    s[3] = (rlhk_rand_u32)RLHK_RAND_ROTL32(s3, 11);
+    return r * 9 & 0xffffffffUL;
+}
+
+/* Apply a jump polynomial: the state becomes the sum, over each set
+ * bit b of poly, of the state advanced b steps.
+ */
+static void
+rlhk_rand_xoshiro_poly(rlhk_rand_u32 *s, const unsigned long *poly)
+{
+    unsigned long t[4] = {0, 0, 0, 0};
+    int i, b;
+    for (i = 0; i < 4; i++) {
+        for (b = 0; b < 32; b++) {
+            if (poly[i] >> b & 1) {
+                t[0] ^= s[0];
+                t[1] ^= s[1];
+                t[2] ^= s[2];
+                t[3] ^= s[3];
+            }
+            rlhk_rand_xoshiro(s);
+        }
+    }
+    for (i = 0; i < 4; i++)
+        s[i] = (rlhk_rand_u32)t[i];
+}
+
+RLHK_RAND_API
+void
+rlhk_rand_xoshiro_jump(rlhk_rand_u32 *s)
+{
+    static const unsigned long jump[] = {
+        0x8764000bUL, 0xf542d2d3UL, 0x6fa035c3UL, 0x77f2db5bUL
+    };
+    rlhk_rand_xoshiro_poly(s, jump);
+}
+
+RLHK_RAND_API
+void
+rlhk_rand_xoshiro_long_jump(rlhk_rand_u32 *s)
+{
+    static const unsigned long jump[] = {
+        0xb523952eUL, 0x0b6f099fUL, 0xccf5a0efUL, 0x1c580662UL
+    };
+    rlhk_rand_xoshiro_poly(s, jump);
+}
+
+RLHK_RAND_API
+void
+rlhk_rand_fill_seed(unsigned long *s, rlhk_rand_u32 *lanes)
+{
+    int j;
+    for (j = 0; j < RLHK_RAND_LANES; j++) {
+        /* Mixing keeps the seed non-zero while scattering the lanes
+         * across the generator's cycle.
+         */
+        lanes[j] = (rlhk_rand_u32)rlhk_rand_mix32(rlhk_rand_32(s));
+    }
+}
+
+RLHK_RAND_API
+void
+rlhk_rand_fill_u32(rlhk_rand_u32 *lanes, rlhk_rand_u32 *out, long n)
+{
+    /* A local copy of the lanes so they can't alias out. */
+    rlhk_rand_u32 s[RLHK_RAND_LANES];
+    int j;
+    for (j = 0; j < RLHK_RAND_LANES; j++)
+        s[j] = lanes[j];
+    for (; n >= RLHK_RAND_LANES; n -= RLHK_RAND_LANES) {
+        for (j = 0; j < RLHK_RAND_LANES; j++) {
+            rlhk_rand_u32 x = s[j];
+            x ^= x << 13 & 0xffffffffUL;
+            x ^= x >> 17;
+            x ^= x << 5 & 0xffffffffUL;
+            s[j] = x;
+            out[j] = x;
+        }
+        out += RLHK_RAND_LANES;
+    }
+    for (j = 0; j < n; j++) {
+        rlhk_rand_u32 x = s[j];
+        x ^= x << 13 & 0xffffffffUL;
+        x ^= x >> 17;
+        x ^= x << 5 & 0xffffffffUL;
+        s[j] = x;
+        out[j] = x;
+    }
+    for (j = 0; j < RLHK_RAND_LANES; j++)
+        lanes[j] = s[j];
+}
+
+/* Values generated at a time by the floating point fills. */
+#define RLHK_RAND_CHUNK 256
+
+RLHK_RAND_API
+void
+rlhk_rand_fill_uniform(rlhk_rand_u32 *lanes, double *out, long n)
+{
+    rlhk_rand_u32 raw[RLHK_RAND_CHUNK];
+    while (n > 0) {
+        long i;
+        long c = n < RLHK_RAND_CHUNK ? n : RLHK_RAND_CHUNK;
+        rlhk_rand_fill_u32(lanes, raw, c);
+        for (i = 0; i < c; i++)
+            out[i] = raw[i] / (double)0xffffffffUL;
+        out += c;
+        n -= c;
+    }
+}
+
+RLHK_RAND_API
+void
+rlhk_rand_fill_norm(rlhk_rand_u32 *lanes, double *out, long n)
+{
+    rlhk_rand_u32 raw[RLHK_RAND_CHUNK];
+    while (n > 0) {
+        long i;
+        long c = n < RLHK_RAND_CHUNK ? n : RLHK_RAND_CHUNK;
+        rlhk_rand_fill_u32(lanes, raw, c);
+        for (i = 0; i < c; i++) {
+            unsigned long r = raw[i];
+            unsigned long u = r >> 8;
+            int layer = (int)(r & 0x7f);
+            double x = u * rlhk_rand_zig_w[layer];
+            if (u < rlhk_rand_zig_k[layer]) {
+                out[i] = r >> 7 & 1 ? -x : x;
+            } else {
+                /* Rare: finish from the first lane, serially. */
+                unsigned long t = lanes[0];
+                out[i] = rlhk_rand_zig(&t, r);
+                lanes[0] = (rlhk_rand_u32)(t & 0xffffffffUL);
+            }
+        }
+        out += c;
+        n -= c;
+    }
+}
+
+RLHK_RAND_API
+int
+rlhk_rand_alias_init(struct rlhk_rand_alias *a, long n,
+                     void *buf, long buflen)
+{
+    if (n < 1 || buflen < RLHK_RAND_ALIAS_BUFLEN(n))
+        return 0;
+    a->n = n;
+    a->scaled = buf;
+    a->work = (long *)(a->scaled + n);
+    a->alias = a->work + n;
+    a->prob = (rlhk_rand_u32 *)(a->alias + n);
+    return 1;
+}
+
+RLHK_RAND_API
+int
+rlhk_rand_alias_build(struct rlhk_rand_alias *a, const double *weights)
+{
+    long i;
+    long n = a->n;
+    long nsmall = 0;
+    long nlarge = 0;
+    double total = 0;
+
+    for (i = 0; i < n; i++) {
+        if (weights[i] < 0)
+            return 0;
+        total += weights[i];
+    }
+    if (total <= 0)
+        return 0;
+
+    /* Scale to a mean of 1, then split into entries below the mean,
+     * stacked from the front of work, and the rest, from the back.
+     */
+    for (i = 0; i < n; i++) {
+        a->scaled[i] = weights[i] * n / total;
+        if (a->scaled[i] < 1)
+            a->work[nsmall++] = i;
+        else
+            a->work[n - ++nlarge] = i;
+    }
+
+    /* Top up each small column with part of a large one. */
+    while (nsmall && nlarge) {
+        long l = a->work[--nsmall];
+        long g = a->work[n - nlarge];
+        if (a->scaled[l] < 0)
+            a->scaled[l] = 0; /* rounding */
+        a->prob[l] = (rlhk_rand_u32)(a->scaled[l] * 4294967296.0);
+        a->alias[l] = g;
+        a->scaled[g] -= 1 - a->scaled[l];
+        if (a->scaled[g] < 1) {
+            nlarge--;
+            a->work[nsmall++] = g;
+        }
+    }
+
+    /* What's left is full, up to rounding: it aliases itself. */
+    while (nsmall)
+        a->work[n - ++nlarge] = a->work[--nsmall];
+    while (nlarge) {
+        long g = a->work[n - nlarge--];
+        a->prob[g] = (rlhk_rand_u32)0xffffffffUL;
+        a->alias[g] = g;
+    }
+    return 1;
+}
+
+RLHK_RAND_API
+long
+rlhk_rand_alias_draw(const struct rlhk_rand_alias *a, unsigned long *s)
+{
+    long i = (long)rlhk_rand_range(s, (unsigned long)a->n);
+    return rlhk_rand_32(s) < a->prob[i] ? i : a->alias[i];
 }
 
 #endif /* RLHK_RAND_IMPLEMENTATION */
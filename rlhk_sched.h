@@ -0,0 +1,295 @@
+/* Roguelike Header Kit : Scheduling
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Provides a turn scheduler: a priority queue of actors keyed by the
+ * time of their next action. Actors are identified by an index from 0
+ * to n - 1, and the scheduler keeps one node per actor in an array
+ * you provide, so it makes no allocations and scales to very large
+ * actor counts.
+ *
+ * Internally this is a radix heap. Every time is an unsigned 32-bit
+ * value that must not be earlier than the current time, i.e. the time
+ * of the most recently popped actor, which always holds in a turn
+ * scheduler. Actors are threaded onto doubly-linked lists through
+ * their nodes, so scheduling, rescheduling and removing an actor take
+ * constant time, and popping takes amortized O(log T) for a time
+ * range of T.
+ *
+ * Use rlhk_sched_due() to advance to the next time at which anyone
+ * acts and collect every actor due at that time in one batch, e.g.
+ * to run their AI in parallel.
+ *
+ * Functions:
+ *   - rlhk_sched_init
+ *   - rlhk_sched_at
+ *   - rlhk_sched_remove
+ *   - rlhk_sched_time
+ *   - rlhk_sched_pop
+ *   - rlhk_sched_due
+ */
+#ifndef RLHK_SCHED_H
+#define RLHK_SCHED_H
+
+#ifndef RLHK_SCHED_API
+#  ifdef RLHK_API
+#    define RLHK_SCHED_API RLHK_API
+#  else
+#    define RLHK_SCHED_API
+#  endif
+#endif
+
+/* One bucket for the current time plus one per bit of a time. */
+#define RLHK_SCHED_BUCKETS 33
+
+/**
+ * Per-actor scheduler state. Treat the fields as private.
+ */
+struct rlhk_sched_node {
+    unsigned long time;
+    long prev;
+    long next;
+    int bucket;
+};
+
+/**
+ * The scheduler. The current time (now) may be read but not written.
+ */
+struct rlhk_sched {
+    struct rlhk_sched_node *nodes;
+    long n;
+    long count;
+    unsigned long now;
+    long head[RLHK_SCHED_BUCKETS];
+};
+
+/**
+ * Prepare an empty scheduler for n actors, starting at time 0.
+ *
+ * You must provide the array of n nodes, which need not be
+ * initialized.
+ */
+RLHK_SCHED_API
+void rlhk_sched_init(struct rlhk_sched *sched, struct rlhk_sched_node *nodes,
+                     long n);
+
+/**
+ * Schedule actor id to act at the given time, rescheduling it if it's
+ * already scheduled. Times earlier than the current time are treated
+ * as the current time.
+ */
+RLHK_SCHED_API
+void rlhk_sched_at(struct rlhk_sched *sched, long id, unsigned long time);
+
+/**
+ * Unschedule actor id, if it's scheduled.
+ */
+RLHK_SCHED_API
+void rlhk_sched_remove(struct rlhk_sched *sched, long id);
+
+/**
+ * Returns non-zero if actor id is scheduled, storing its time in
+ * *time.
+ */
+RLHK_SCHED_API
+int rlhk_sched_time(const struct rlhk_sched *sched, long id,
+                    unsigned long *time);
+
+/**
+ * Unschedule and return the actor with the earliest time, advancing
+ * the current time to it. Actors sharing a time are returned in no
+ * particular order.
+ *
+ * Returns the actor's id, or -1 if no actors are scheduled.
+ */
+RLHK_SCHED_API
+long rlhk_sched_pop(struct rlhk_sched *sched);
+
+/**
+ * Advance the current time to the earliest scheduled time, then
+ * unschedule the actors due at that time and store up to max of their
+ * ids in ids. Any actors beyond max remain due, and are returned by
+ * the next call.
+ *
+ * Returns the number of ids stored, or 0 if no actors are scheduled.
+ */
+RLHK_SCHED_API
+long rlhk_sched_due(struct rlhk_sched *sched, long *ids, long max);
+
+/* Implementation */
+#if defined(RLHK_IMPLEMENTATION) || defined(RLHK_SCHED_IMPLEMENTATION)
+
+/* Bucket 0 holds the current time. Bucket i holds times whose highest
+ * bit differing from the current time is bit i - 1.
+ */
+static int
+rlhk_sched_bucket(unsigned long now, unsigned long time)
+{
+    unsigned long x = (now ^ time) & 0xffffffffUL;
+    int b = 0;
+    if (x >> 16) {
+        x >>= 16;
+        b += 16;
+    }
+    if (x >> 8) {
+        x >>= 8;
+        b += 8;
+    }
+    if (x >> 4) {
+        x >>= 4;
+        b += 4;
+    }
+    if (x >> 2) {
+        x >>= 2;
+        b += 2;
+    }
+    if (x >> 1) {
+        x >>= 1;
+        b += 1;
+    }
+    return (int)x + b;
+}
+
+static void
+rlhk_sched_link(struct rlhk_sched *s, long id, int bucket)
+{
+    struct rlhk_sched_node *node = s->nodes + id;
+    long head = s->head[bucket];
+    node->bucket = bucket;
+    node->prev = -1;
+    node->next = head;
+    if (head >= 0)
+        s->nodes[head].prev = id;
+    s->head[bucket] = id;
+}
+
+static void
+rlhk_sched_unlink(struct rlhk_sched *s, long id)
+{
+    struct rlhk_sched_node *node = s->nodes + id;
+    if (node->prev >= 0)
+        s->nodes[node->prev].next = node->next;
+    else
+        s->head[node->bucket] = node->next;
+    if (node->next >= 0)
+        s->nodes[node->next].prev = node->prev;
+    node->bucket = -1;
+}
+
+/* Make bucket 0 non-empty by advancing the current time to the
+ * earliest time and redistributing its bucket. Returns 0 if empty.
+ */
+static int
+rlhk_sched_advance(struct rlhk_sched *s)
+{
+    int b;
+    long id;
+    unsigned long min;
+
+    if (s->head[0] >= 0)
+        return 1;
+    b = 1;
+    while (b < RLHK_SCHED_BUCKETS && s->head[b] < 0)
+        b++;
+    if (b == RLHK_SCHED_BUCKETS)
+        return 0;
+
+    min = s->nodes[s->head[b]].time;
+    for (id = s->head[b]; id >= 0; id = s->nodes[id].next)
+        if (s->nodes[id].time < min)
+            min = s->nodes[id].time;
+    s->now = min;
+
+    /* Every node moves to a strictly lower bucket. */
+    id = s->head[b];
+    s->head[b] = -1;
+    while (id >= 0) {
+        long next = s->nodes[id].next;
+        rlhk_sched_link(s, id, rlhk_sched_bucket(min, s->nodes[id].time));
+        id = next;
+    }
+    return 1;
+}
+
+RLHK_SCHED_API
+void
+rlhk_sched_init(struct rlhk_sched *s, struct rlhk_sched_node *nodes, long n)
+{
+    long i;
+    int b;
+    s->nodes = nodes;
+    s->n = n;
+    s->count = 0;
+    s->now = 0;
+    for (b = 0; b < RLHK_SCHED_BUCKETS; b++)
+        s->head[b] = -1;
+    for (i = 0; i < n; i++)
+        nodes[i].bucket = -1;
+}
+
+RLHK_SCHED_API
+void
+rlhk_sched_at(struct rlhk_sched *s, long id, unsigned long time)
+{
+    time &= 0xffffffffUL;
+    if (time < s->now)
+        time = s->now;
+    if (s->nodes[id].bucket >= 0)
+        rlhk_sched_unlink(s, id);
+    else
+        s->count++;
+    s->nodes[id].time = time;
+    rlhk_sched_link(s, id, rlhk_sched_bucket(s->now, time));
+}
+
+RLHK_SCHED_API
+void
+rlhk_sched_remove(struct rlhk_sched *s, long id)
+{
+    if (s->nodes[id].bucket < 0)
+        return;
+    rlhk_sched_unlink(s, id);
+    s->count--;
+}
+
+RLHK_SCHED_API
+int
+rlhk_sched_time(const struct rlhk_sched *s, long id, unsigned long *time)
+{
+    if (s->nodes[id].bucket < 0)
+        return 0;
+    *time = s->nodes[id].time;
+    return 1;
+}
+
+RLHK_SCHED_API
+long
+rlhk_sched_pop(struct rlhk_sched *s)
+{
+    long id;
+    if (!rlhk_sched_advance(s))
+        return -1;
+    id = s->head[0];
+    rlhk_sched_unlink(s, id);
+    s->count--;
+    return id;
+}
+
+RLHK_SCHED_API
+long
+rlhk_sched_due(struct rlhk_sched *s, long *ids, long max)
+{
+    long n = 0;
+    if (!rlhk_sched_advance(s))
+        return 0;
+    while (n < max && s->head[0] >= 0) {
+        long id = s->head[0];
+        rlhk_sched_unlink(s, id);
+        ids[n++] = id;
+    }
+    s->count -= n;
+    return n;
+}
+
+#endif /* RLHK_SCHED_IMPLEMENTATION */
+#endif /* RLHK_SCHED_H */
@@ -0,0 +1,347 @@
+/* Roguelike Header Kit : Spatial Index
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Provides a fixed-capacity index of entities (monsters, items, etc.)
+ * by map tile. Entities are identified by an index from 0 to n - 1,
+ * and the index keeps one node per entity in an array you provide,
+ * threading the entities on each tile onto an intrusive doubly-linked
+ * list. Placing, moving and removing an entity take constant time, as
+ * does finding the entities on a tile, so it's cheap enough to use
+ * from within rlhk_algo_map_call():
+ *
+ *     case RLHK_ALGO_MAP_GET_PASSABLE:
+ *         return !wall[y][x] && !RLHK_SPACE_OCCUPIED(space, x, y);
+ *
+ * The index also maintains an occupancy bitboard with a set bit for
+ * each tile holding at least one entity. It uses the same layout as
+ * rlhk_gen.h, so rlhk_space_merge() can combine it with a wall
+ * bitboard for rlhk_algo_dijkstra_many(). Rectangle and radius
+ * queries skip over empty runs of the bitboard a word at a time.
+ *
+ * Functions:
+ *   - rlhk_space_init
+ *   - rlhk_space_place
+ *   - rlhk_space_remove
+ *   - rlhk_space_first
+ *   - rlhk_space_next
+ *   - rlhk_space_rect
+ *   - rlhk_space_radius
+ *   - rlhk_space_merge
+ */
+#ifndef RLHK_SPACE_H
+#define RLHK_SPACE_H
+
+#ifndef RLHK_SPACE_API
+#  ifdef RLHK_API
+#    define RLHK_SPACE_API RLHK_API
+#  else
+#    define RLHK_SPACE_API
+#  endif
+#endif
+
+#include <limits.h>
+
+#define RLHK_SPACE_WBITS ((int)(CHAR_BIT * sizeof(unsigned long)))
+#define RLHK_SPACE_STRIDE(w) (((w) + RLHK_SPACE_WBITS - 1) / RLHK_SPACE_WBITS)
+
+/**
+ * Returns non-zero if any entity is at (x, y), which must be within
+ * the map.
+ */
+#define RLHK_SPACE_OCCUPIED(space, x, y) \
+    ((int)((space)->occupied[(long)(y) * (space)->stride + \
+                             (x) / RLHK_SPACE_WBITS] >> \
+           ((x) % RLHK_SPACE_WBITS)) & 1)
+
+/**
+ * Per-entity index state. An entity is placed when x is non-negative.
+ * Treat the fields as read-only.
+ */
+struct rlhk_space_node {
+    int x;
+    int y;
+    long prev;
+    long next;
+};
+
+/**
+ * The index. The occupancy bitboard (occupied) may be read but not
+ * written. Treat the other fields as private.
+ */
+struct rlhk_space {
+    struct rlhk_space_node *nodes;
+    long *heads;
+    unsigned long *occupied;
+    long n;
+    int width;
+    int height;
+    int stride;
+};
+
+/**
+ * Always-sufficient index buffer size, in bytes, for a width by
+ * height map.
+ */
+#define RLHK_SPACE_BUFLEN(width, height) \
+    ((long)((height) * \
+            ((width) * sizeof(long) + \
+             RLHK_SPACE_STRIDE(width) * sizeof(unsigned long))))
+
+/**
+ * Prepare an empty index for n entities over a width by height map.
+ *
+ * You must provide the array of n nodes, and the index's memory (buf)
+ * and its size in bytes (buflen), suitably aligned for a long. Neither
+ * need be initialized.
+ *
+ * Returns 1 on success or 0 if the buffer is too small.
+ */
+RLHK_SPACE_API
+int rlhk_space_init(struct rlhk_space *space, int width, int height,
+                    struct rlhk_space_node *nodes, long n,
+                    void *buf, long buflen);
+
+/**
+ * Place entity id at (x, y), moving it if it's already placed.
+ *
+ * Returns 1 on success or 0 if (x, y) is outside the map, in which
+ * case the entity isn't moved.
+ */
+RLHK_SPACE_API
+int rlhk_space_place(struct rlhk_space *space, long id, int x, int y);
+
+/**
+ * Take entity id out of the index, if it's placed.
+ */
+RLHK_SPACE_API
+void rlhk_space_remove(struct rlhk_space *space, long id);
+
+/**
+ * Returns the first entity at (x, y), or -1 if there are none or the
+ * tile is outside the map. Follow up with rlhk_space_next().
+ */
+RLHK_SPACE_API
+long rlhk_space_first(const struct rlhk_space *space, int x, int y);
+
+/**
+ * Returns the next entity on the same tile as entity id, or -1.
+ */
+RLHK_SPACE_API
+long rlhk_space_next(const struct rlhk_space *space, long id);
+
+/**
+ * Find the entities in the inclusive rectangle from (x0, y0) to
+ * (x1, y1), storing up to max of their ids in ids, tile by tile in
+ * row-major order. The corners may be given in any order, and parts
+ * of the rectangle outside the map are ignored.
+ *
+ * Returns the number of entities found, which may exceed max.
+ */
+RLHK_SPACE_API
+long rlhk_space_rect(const struct rlhk_space *space,
+                     int x0, int y0, int x1, int y1, long *ids, long max);
+
+/**
+ * Find the entities within the given (Euclidean) radius of (x, y),
+ * as rlhk_space_rect().
+ *
+ * Returns the number of entities found, which may exceed max.
+ */
+RLHK_SPACE_API
+long rlhk_space_radius(const struct rlhk_space *space, int x, int y,
+                       int radius, long *ids, long max);
+
+/**
+ * Combine the occupancy bitboard with a bitboard of walls, both in
+ * the rlhk_gen.h layout, storing the union in dst, which may be the
+ * same as walls. The result treats occupied tiles as walls, such as
+ * for rlhk_algo_dijkstra_many().
+ */
+RLHK_SPACE_API
+void rlhk_space_merge(const struct rlhk_space *space,
+                      const unsigned long *walls, unsigned long *dst);
+
+/* Implementation */
+#if defined(RLHK_IMPLEMENTATION) || defined(RLHK_SPACE_IMPLEMENTATION)
+
+RLHK_SPACE_API
+int
+rlhk_space_init(struct rlhk_space *space, int width, int height,
+                struct rlhk_space_node *nodes, long n,
+                void *buf, long buflen)
+{
+    long i;
+    long tiles = (long)width * height;
+    if (width < 1 || height < 1 || buflen < RLHK_SPACE_BUFLEN(width, height))
+        return 0;
+    space->nodes = nodes;
+    space->n = n;
+    space->width = width;
+    space->height = height;
+    space->stride = RLHK_SPACE_STRIDE(width);
+    space->occupied = buf;
+    space->heads = (long *)(space->occupied + (long)height * space->stride);
+    for (i = 0; i < (long)height * space->stride; i++)
+        space->occupied[i] = 0;
+    for (i = 0; i < tiles; i++)
+        space->heads[i] = -1;
+    for (i = 0; i < n; i++)
+        nodes[i].x = -1;
+    return 1;
+}
+
+RLHK_SPACE_API
+void
+rlhk_space_remove(struct rlhk_space *space, long id)
+{
+    struct rlhk_space_node *node = space->nodes + id;
+    long tile;
+    if (node->x < 0)
+        return;
+    tile = (long)node->y * space->width + node->x;
+    if (node->prev >= 0)
+        space->nodes[node->prev].next = node->next;
+    else
+        space->heads[tile] = node->next;
+    if (node->next >= 0)
+        space->nodes[node->next].prev = node->prev;
+    if (space->heads[tile] < 0)
+        space->occupied[(long)node->y * space->stride +
+                        node->x / RLHK_SPACE_WBITS] &=
+            ~(1UL << (node->x % RLHK_SPACE_WBITS));
+    node->x = -1;
+}
+
+RLHK_SPACE_API
+int
+rlhk_space_place(struct rlhk_space *space, long id, int x, int y)
+{
+    struct rlhk_space_node *node = space->nodes + id;
+    long tile = (long)y * space->width + x;
+    long head;
+    if (x < 0 || y < 0 || x >= space->width || y >= space->height)
+        return 0;
+    if (node->x == x && node->y == y)
+        return 1;
+    rlhk_space_remove(space, id);
+    head = space->heads[tile];
+    node->x = x;
+    node->y = y;
+    node->prev = -1;
+    node->next = head;
+    if (head >= 0)
+        space->nodes[head].prev = id;
+    space->heads[tile] = id;
+    space->occupied[(long)y * space->stride + x / RLHK_SPACE_WBITS] |=
+        1UL << (x % RLHK_SPACE_WBITS);
+    return 1;
+}
+
+RLHK_SPACE_API
+long
+rlhk_space_first(const struct rlhk_space *space, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= space->width || y >= space->height)
+        return -1;
+    return space->heads[(long)y * space->width + x];
+}
+
+RLHK_SPACE_API
+long
+rlhk_space_next(const struct rlhk_space *space, long id)
+{
+    return space->nodes[id].next;
+}
+
+/* Shared by rect and radius queries: a negative r2 means no radius. */
+static long
+rlhk_space_query(const struct rlhk_space *space, int x0, int y0,
+                 int x1, int y1, int cx, int cy, long r2,
+                 long *ids, long max)
+{
+    int x, y;
+    long n = 0;
+    if (x0 < 0)
+        x0 = 0;
+    if (y0 < 0)
+        y0 = 0;
+    if (x1 >= space->width)
+        x1 = space->width - 1;
+    if (y1 >= space->height)
+        y1 = space->height - 1;
+    for (y = y0; y <= y1; y++) {
+        const unsigned long *row = space->occupied + (long)y * space->stride;
+        x = x0;
+        while (x <= x1) {
+            long id;
+            unsigned long word = row[x / RLHK_SPACE_WBITS];
+            if (!(word >> (x % RLHK_SPACE_WBITS))) {
+                /* Nothing else in this word. */
+                x += RLHK_SPACE_WBITS - x % RLHK_SPACE_WBITS;
+                continue;
+            }
+            if (!(word >> (x % RLHK_SPACE_WBITS) & 1)) {
+                x++;
+                continue;
+            }
+            if (r2 >= 0 &&
+                (long)(x - cx) * (x - cx) + (long)(y - cy) * (y - cy) > r2) {
+                x++;
+                continue;
+            }
+            id = space->heads[(long)y * space->width + x];
+            for (; id >= 0; id = space->nodes[id].next) {
+                if (n < max)
+                    ids[n] = id;
+                n++;
+            }
+            x++;
+        }
+    }
+    return n;
+}
+
+RLHK_SPACE_API
+long
+rlhk_space_rect(const struct rlhk_space *space,
+                int x0, int y0, int x1, int y1, long *ids, long max)
+{
+    if (x1 < x0) {
+        int t = x0;
+        x0 = x1;
+        x1 = t;
+    }
+    if (y1 < y0) {
+        int t = y0;
+        y0 = y1;
+        y1 = t;
+    }
+    return rlhk_space_query(space, x0, y0, x1, y1, 0, 0, -1, ids, max);
+}
+
+RLHK_SPACE_API
+long
+rlhk_space_radius(const struct rlhk_space *space, int x, int y,
+                  int radius, long *ids, long max)
+{
+    long r2 = (long)radius * radius;
+    if (radius < 0)
+        return 0;
+    return rlhk_space_query(space, x - radius, y - radius,
+                            x + radius, y + radius, x, y, r2, ids, max);
+}
+
+RLHK_SPACE_API
+void
+rlhk_space_merge(const struct rlhk_space *space,
+                 const unsigned long *walls, unsigned long *dst)
+{
+    long i;
+    long n = (long)space->height * space->stride;
+    for (i = 0; i < n; i++)
+        dst[i] = walls[i] | space->occupied[i];
+}
+
+#endif /* RLHK_SPACE_IMPLEMENTATION */
+#endif /* RLHK_SPACE_H */
@@ -10,7 +10,12 @@
  * this module.
  *
  * For POSIX systems, the terminal is assumed to support ANSI escapes
- * and UTF-8 encoding.
+ * and UTF-8 encoding. All output is written with the POSIX-style
+ * RLHK_TUI_WRITE(fd, buf, len), which defaults to write(). You may
+ * define your own to redirect output, such as into a memory sink.
+ * Terminal modes are set with RLHK_TUI_TCSETATTR(fd, act, termios),
+ * which defaults to tcsetattr(). A sink that is not a terminal may
+ * define it to 0 so that the real terminal is never put in raw mode.
  *
  * This library does not require nor use stdio.h. This may be useful
  * in some circumstances, such as builds with a static libc.
@@ -108,6 +113,11 @@ void rlhk_tui_putc(int x, int y, unsigned c, unsigned attr);
  * Calls to rlhk_tui_putc() are not visible until this call. You
  * probably want to call this function before rlhk_tui_getch().
  *
+ * Only cells that changed since the last flush are written, and the
+ * cost of a flush is proportional to the span of each row touched by
+ * rlhk_tui_putc(), not to the size of the display. It's fine to redraw
+ * cells with their current contents.
+ *
  * Returns 1 on success, 0 on failure.
  */
 RLHK_TUI_API
@@ -932,6 +942,14 @@ static int rlhk_tui_height;
 #include <termios.h>
 #include <sys/ioctl.h>
 
+#ifndef RLHK_TUI_WRITE
+#  define RLHK_TUI_WRITE(fd, buf, len) write(fd, buf, len)
+#endif
+
+#ifndef RLHK_TUI_TCSETATTR
+#  define RLHK_TUI_TCSETATTR(fd, act, t) tcsetattr(fd, act, t)
+#endif
+
 struct termios rlhk_tui_termios_orig;
 
 /* The last written display. */
@@ -942,6 +960,12 @@ static unsigned char rlhk_tui_olda[RLHK_TUI_MAX_HEIGHT][RLHK_TUI_MAX_WIDTH];
 static unsigned rlhk_tui_bufc[RLHK_TUI_MAX_HEIGHT][RLHK_TUI_MAX_WIDTH];
 static unsigned char rlhk_tui_bufa[RLHK_TUI_MAX_HEIGHT][RLHK_TUI_MAX_WIDTH];
 
+/* Inclusive column span of each row that may differ from the last
+ * written display. A row is clean when lo > hi.
+ */
+static int rlhk_tui_lo[RLHK_TUI_MAX_HEIGHT];
+static int rlhk_tui_hi[RLHK_TUI_MAX_HEIGHT];
+
 static unsigned char *
 rlhk_tui_itoa(unsigned char *p, int v)
 {
@@ -959,12 +983,17 @@ int
 rlhk_tui_init(int width, int height)
 {
     struct termios raw;
+    int y;
     char init[] = {
         "\x1b[2J"   /* Clear the screen. */
         "\x1b[?25l" /* Hide the cursor. */
     };
     rlhk_tui_width = width;
     rlhk_tui_height = height;
+    for (y = 0; y < height; y++) {
+        rlhk_tui_lo[y] = 0;
+        rlhk_tui_hi[y] = width - 1;
+    }
     if (tcgetattr(STDIN_FILENO, &rlhk_tui_termios_orig) == -1)
         return 0;
     memcpy(&raw, &rlhk_tui_termios_orig, sizeof(raw));
@@ -973,9 +1002,10 @@ rlhk_tui_init(int width, int height)
     raw.c_lflag &= ~(ECHO|ECHONL|ICANON|ISIG|IEXTEN);
     raw.c_cflag &= ~(CSIZE|PARENB);
     raw.c_cflag |= CS8;
-    if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) == -1)
+    if (RLHK_TUI_TCSETATTR(STDIN_FILENO, TCSANOW, &raw) == -1)
         return 0;
-    return write(STDIN_FILENO, init, sizeof(init) - 1) == sizeof(init) - 1;
+    return RLHK_TUI_WRITE(STDIN_FILENO, init, sizeof(init) - 1) ==
+           sizeof(init) - 1;
 }
 
 RLHK_TUI_API
@@ -989,17 +1019,23 @@ rlhk_tui_release(void)
     unsigned char *f = (unsigned char *)finish + strlen(finish);
     char *p = (char *)rlhk_tui_itoa(f, rlhk_tui_height);
     strcpy(p, ";0H" "\x1b[0m\n");  /* Disable color/style. */
-    tcsetattr(STDIN_FILENO, TCSANOW, &rlhk_tui_termios_orig);
+    (void)RLHK_TUI_TCSETATTR(STDIN_FILENO, TCSANOW, &rlhk_tui_termios_orig);
     memset(rlhk_tui_oldc, 0, sizeof(rlhk_tui_oldc));
-    return write(STDIN_FILENO, finish, finishz) == finishz;
+    return RLHK_TUI_WRITE(STDIN_FILENO, finish, finishz) == finishz;
 }
 
 RLHK_TUI_API
 void
 rlhk_tui_putc(int x, int y, unsigned c, unsigned attr)
 {
+    if (rlhk_tui_bufc[y][x] == c && rlhk_tui_bufa[y][x] == attr)
+        return;
     rlhk_tui_bufc[y][x] = c;
     rlhk_tui_bufa[y][x] = attr;
+    if (x < rlhk_tui_lo[y])
+        rlhk_tui_lo[y] = x;
+    if (x > rlhk_tui_hi[y])
+        rlhk_tui_hi[y] = x;
 }
 
 RLHK_TUI_API
@@ -1015,7 +1051,18 @@ rlhk_tui_flush(void)
     int cx = -1;
     int cy = -1;
     for (y = 0; y < rlhk_tui_height; y++) {
-        for (x = 0; x < rlhk_tui_width; x++) {
+        int lo = rlhk_tui_lo[y];
+        int hi = rlhk_tui_hi[y];
+        if (lo > hi)
+            continue;
+        rlhk_tui_lo[y] = rlhk_tui_width;
+        rlhk_tui_hi[y] = -1;
+        /* Let memcmp() reject a span rewritten with its old contents. */
+        if (!memcmp(rlhk_tui_oldc[y] + lo, rlhk_tui_bufc[y] + lo,
+                    (hi - lo + 1) * sizeof(rlhk_tui_oldc[0][0])) &&
+            !memcmp(rlhk_tui_olda[y] + lo, rlhk_tui_bufa[y] + lo, hi - lo + 1))
+            continue;
+        for (x = lo; x <= hi; x++) {
             unsigned *oc = &rlhk_tui_oldc[y][x];
             unsigned char *oa = &rlhk_tui_olda[y][x];
             unsigned c = rlhk_tui_bufc[y][x];
@@ -1054,7 +1101,7 @@ rlhk_tui_flush(void)
             }
         }
     }
-    return write(STDOUT_FILENO, buf, p - buf) == p - buf;
+    return RLHK_TUI_WRITE(STDOUT_FILENO, buf, p - buf) == p - buf;
 }
 
 RLHK_TUI_API
@@ -1081,11 +1128,11 @@ rlhk_tui_title(const char *title)
 {
     char a = '\a';
     ssize_t len = strlen(title);
-    if (write(STDIN_FILENO, "\x1b]2;", 4) != 4)
+    if (RLHK_TUI_WRITE(STDIN_FILENO, "\x1b]2;", 4) != 4)
         return 0;
-    if (write(STDIN_FILENO, title, len) != len)
+    if (RLHK_TUI_WRITE(STDIN_FILENO, title, len) != len)
         return 0;
-    if (write(STDIN_FILENO, &a, 1) != 1)
+    if (RLHK_TUI_WRITE(STDIN_FILENO, &a, 1) != 1)
         return 0;
     return 1;
 }